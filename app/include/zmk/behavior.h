@@ -15,6 +15,9 @@ struct zmk_behavior_binding {
     char *behavior_dev;
     uint32_t param1;
     uint32_t param2;
+    // Device for behavior_dev, filled in once by zmk_behavior_binding_resolve() for bindings that
+    // live for the lifetime of the firmware. NULL means the device is looked up by name on use.
+    const struct device *resolved_dev;
 };
 
 struct zmk_behavior_binding_event {
@@ -36,3 +39,37 @@ struct zmk_behavior_binding_event {
  * unrelated node which shares the same name as a behavior.
  */
 const struct device *zmk_behavior_get_binding(const char *name);
+
+/**
+ * @brief Look up the behavior device for @p binding once and cache it in the binding.
+ *
+ * Behavior devices are initialized at POST_KERNEL, so this must be called from
+ * APPLICATION level initialization or later.
+ *
+ * @param binding Binding to resolve.
+ *
+ * @retval 0 If the device was found.
+ * @retval -ENODEV If no ready behavior has the binding's name. The binding
+ * then falls back to looking up the device by name each time it is used.
+ */
+int zmk_behavior_binding_resolve(struct zmk_behavior_binding *binding);
+
+/**
+ * @brief Get the behavior device for @p binding.
+ *
+ * Uses the device cached by zmk_behavior_binding_resolve() when available, so
+ * resolved bindings never need a name lookup.
+ *
+ * @param binding Binding to get the device for.
+ *
+ * @retval Pointer to the device structure for the binding's behavior.
+ * @retval NULL if the behavior is not found or its initialization function failed.
+ */
+static inline const struct device *
+zmk_behavior_binding_get_device(const struct zmk_behavior_binding *binding) {
+    if (binding->resolved_dev != NULL) {
+        return binding->resolved_dev;
+    }
+
+    return zmk_behavior_get_binding(binding->behavior_dev);
+}
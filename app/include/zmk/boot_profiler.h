@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+enum zmk_boot_profiler_level {
+    ZMK_BOOT_PROFILER_LEVEL_PRE_KERNEL_1,
+    ZMK_BOOT_PROFILER_LEVEL_PRE_KERNEL_2,
+    ZMK_BOOT_PROFILER_LEVEL_POST_KERNEL,
+    ZMK_BOOT_PROFILER_LEVEL_APPLICATION,
+    ZMK_BOOT_PROFILER_LEVELS,
+};
+
+#if IS_ENABLED(CONFIG_ZMK_BOOT_PROFILER)
+
+uint64_t zmk_boot_profiler_now(void);
+void zmk_boot_profiler_record(const char *name, enum zmk_boot_profiler_level level,
+                              uint64_t start);
+
+// Called once the keys are being scanned, which ends the profile and reports it.
+void zmk_boot_profiler_scan_started(void);
+void zmk_boot_profiler_log(void);
+
+/*
+ * Drop-in replacement for SYS_INIT() that times the init function. Device init functions are
+ * run by Zephyr and can't be wrapped, so the profiler reports the time each init level spends
+ * outside of ZMK init functions as one entry per level.
+ */
+#define ZMK_SYS_INIT(init_fn, level, prio)                                                         \
+    static int _CONCAT(init_fn, _profiled)(void) {                                                 \
+        uint64_t start = zmk_boot_profiler_now();                                                  \
+        int ret = init_fn();                                                                       \
+        zmk_boot_profiler_record(STRINGIFY(init_fn), ZMK_BOOT_PROFILER_LEVEL_##level, start);      \
+        return ret;                                                                                \
+    }                                                                                              \
+    SYS_INIT(_CONCAT(init_fn, _profiled), level, prio)
+
+#else
+
+static inline void zmk_boot_profiler_scan_started(void) {}
+static inline void zmk_boot_profiler_log(void) {}
+
+#define ZMK_SYS_INIT(init_fn, level, prio) SYS_INIT(init_fn, level, prio)
+
+#endif
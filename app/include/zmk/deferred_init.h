@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/iterable_sections.h>
+
+#include <zmk/boot_profiler.h>
+
+#if IS_ENABLED(CONFIG_ZMK_DEFERRED_INIT)
+
+struct zmk_deferred_init {
+    const char *name;
+    int (*init)(void);
+};
+
+/**
+ * Registers @p init_fn for a subsystem that isn't needed to read and send key presses, such as
+ * a display or RGB underglow. Deferred init functions are run on the low priority work queue
+ * once main() has started scanning keys, so key events can be processed while they run.
+ *
+ * Listeners and APIs of a deferred subsystem may be called before its init function has run.
+ */
+#define ZMK_DEFERRED_INIT(init_fn)                                                                 \
+    static const STRUCT_SECTION_ITERABLE(zmk_deferred_init,                                        \
+                                         _CONCAT(zmk_deferred_init_, init_fn)) = {                 \
+        .name = STRINGIFY(init_fn),                                                                \
+        .init = init_fn,                                                                           \
+    }
+
+// Called from main() once the keys are being scanned.
+void zmk_deferred_init_start(void);
+
+#else
+
+#define ZMK_DEFERRED_INIT(init_fn)                                                                 \
+    ZMK_SYS_INIT(init_fn, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY)
+
+static inline void zmk_deferred_init_start(void) {}
+
+#endif
@@ -68,8 +68,19 @@ int zmk_endpoints_toggle_transport(void);
  */
 struct zmk_endpoint_instance zmk_endpoints_selected(void);
 
+/**
+ * Sends the report for the given usage page. If CONFIG_ZMK_ENDPOINTS_COALESCE_REPORTS is
+ * enabled, the report is only marked as changed and sent once the current burst of events
+ * has been processed.
+ */
 int zmk_endpoints_send_report(uint16_t usage_page);
 
+/**
+ * Immediately sends all reports that were marked as changed but not sent yet. Use this
+ * before a change that must not be merged with earlier ones, such as a key release.
+ */
+int zmk_endpoints_flush_reports(void);
+
 #if IS_ENABLED(CONFIG_ZMK_MOUSE)
 int zmk_endpoints_send_mouse_report();
 #endif // IS_ENABLE(CONFIG_ZMK_MOUSE)
@@ -10,8 +10,18 @@
 #include <zephyr/kernel.h>
 #include <zephyr/types.h>
 
+/*
+ * Location of an event type's subscribers within the link-time sorted subscription table.
+ * Filled in once at init by the event manager.
+ */
+struct zmk_event_subscribers {
+    uint8_t start;
+    uint8_t len;
+};
+
 struct zmk_event_type {
     const char *name;
+    struct zmk_event_subscribers *subscribers;
 };
 
 typedef struct {
@@ -44,7 +54,9 @@ struct zmk_event_subscription {
     extern const struct zmk_event_type zmk_event_##event_type;
 
 #define ZMK_EVENT_IMPL(event_type)                                                                 \
-    const struct zmk_event_type zmk_event_##event_type = {.name = STRINGIFY(event_type)};          \
+    static struct zmk_event_subscribers zmk_event_subscribers_##event_type;                        \
+    const struct zmk_event_type zmk_event_##event_type = {                                         \
+        .name = STRINGIFY(event_type), .subscribers = &zmk_event_subscribers_##event_type};        \
     const struct zmk_event_type *zmk_event_ref_##event_type __used                                 \
         __attribute__((__section__(".event_type"))) = &zmk_event_##event_type;                     \
     struct event_type##_event copy_raised_##event_type(const struct event_type *ev) {              \
@@ -66,7 +78,7 @@ struct zmk_event_subscription {
 #define ZMK_SUBSCRIPTION(mod, ev_type)                                                             \
     const Z_DECL_ALIGN(struct zmk_event_subscription)                                              \
         _CONCAT(_CONCAT(zmk_event_sub_, mod), ev_type) __used                                      \
-        __attribute__((__section__(".event_subscription"))) = {                                    \
+        __attribute__((__section__(".event_subscription." STRINGIFY(ev_type)))) = {                \
             .event_type = &zmk_event_##ev_type,                                                    \
             .listener = &zmk_listener_##mod,                                                       \
     };
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/math_extras.h>
+#include <zephyr/sys/util.h>
+
+/*
+ * Fixed-size pools for events that listeners hold on to after they have been raised, such as
+ * the key position events captured by hold-taps and combos.
+ *
+ * capture_<event_type>() copies a raised event into a pool slot and returns a pointer to it,
+ * which can later be passed to ZMK_EVENT_RAISE*() or ZMK_EVENT_RELEASE() without copying the
+ * event again. If the event being captured is already in the pool, because it was raised from
+ * there by another listener, the slot is shared and only its reference count goes up. Every
+ * capture must be matched by a call to free_captured_<event_type>().
+ *
+ * Events are captured and freed from the system work queue, so the pools have no locks.
+ */
+
+struct zmk_event_pool_stats {
+    const char *name;
+    uint16_t size;
+    uint16_t used;
+    uint16_t peak;
+    // events copied into the pool
+    uint32_t captures;
+    // captures of events that were already in the pool, which only took a reference
+    uint32_t shared;
+    // captures that failed because every slot was in use
+    uint32_t overflows;
+};
+
+#define ZMK_EVENT_POOL_DECLARE(event_type)                                                         \
+    struct event_type##_event *capture_##event_type(const struct event_type *ev);                  \
+    void free_captured_##event_type(struct event_type##_event *ev);
+
+#define ZMK_EVENT_POOL_IMPL(event_type, pool_size)                                                 \
+    static struct event_type##_event event_type##_pool[pool_size];                                 \
+    static uint8_t event_type##_pool_refs[pool_size];                                              \
+    static uint32_t event_type##_pool_free[DIV_ROUND_UP(pool_size, 32)] = {                        \
+        [0 ... DIV_ROUND_UP(pool_size, 32) - 1] = UINT32_MAX};                                     \
+    static struct zmk_event_pool_stats event_type##_pool_stats = {.name = STRINGIFY(event_type),   \
+                                                                  .size = pool_size};              \
+    struct zmk_event_pool_stats *zmk_event_pool_ref_##event_type __used                            \
+        __attribute__((__section__(".event_pool"))) = &event_type##_pool_stats;                    \
+    struct event_type##_event *capture_##event_type(const struct event_type *ev) {                 \
+        struct event_type##_event *outer = CONTAINER_OF(ev, struct event_type##_event, data);      \
+        struct zmk_event_pool_stats *stats = &event_type##_pool_stats;                             \
+        if (outer >= event_type##_pool && outer < event_type##_pool + pool_size) {                 \
+            event_type##_pool_refs[outer - event_type##_pool]++;                                   \
+            stats->shared++;                                                                       \
+            return outer;                                                                          \
+        }                                                                                          \
+        for (int i = 0; i < ARRAY_SIZE(event_type##_pool_free); i++) {                             \
+            uint32_t bits = event_type##_pool_free[i];                                             \
+            int index = i * 32 + u32_count_trailing_zeros(bits);                                   \
+            if (bits == 0 || index >= pool_size) {                                                 \
+                continue;                                                                          \
+            }                                                                                      \
+            event_type##_pool_free[i] &= ~BIT(index % 32);                                         \
+            event_type##_pool_refs[index] = 1;                                                     \
+            event_type##_pool[index] = *outer;                                                     \
+            stats->used++;                                                                         \
+            stats->peak = MAX(stats->peak, stats->used);                                           \
+            stats->captures++;                                                                     \
+            return &event_type##_pool[index];                                                      \
+        }                                                                                          \
+        stats->overflows++;                                                                        \
+        return NULL;                                                                               \
+    }                                                                                              \
+    void free_captured_##event_type(struct event_type##_event *ev) {                               \
+        int index = ev - event_type##_pool;                                                        \
+        __ASSERT(index >= 0 && index < pool_size && event_type##_pool_refs[index] > 0,             \
+                 "Freeing an event that is not captured");                                         \
+        if (--event_type##_pool_refs[index] == 0) {                                                \
+            event_type##_pool_free[index / 32] |= BIT(index % 32);                                 \
+            event_type##_pool_stats.used--;                                                        \
+        }                                                                                          \
+    }
@@ -8,6 +8,7 @@
 
 #include <zephyr/kernel.h>
 #include <zmk/event_manager.h>
+#include <zmk/event_pool.h>
 #include <zmk/keys.h>
 
 struct zmk_keycode_state_changed {
@@ -20,6 +21,7 @@ struct zmk_keycode_state_changed {
 };
 
 ZMK_EVENT_DECLARE(zmk_keycode_state_changed);
+ZMK_EVENT_POOL_DECLARE(zmk_keycode_state_changed);
 
 static inline struct zmk_keycode_state_changed
 zmk_keycode_state_changed_from_encoded(uint32_t encoded, bool pressed, int64_t timestamp) {
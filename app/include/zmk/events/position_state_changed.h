@@ -8,6 +8,7 @@
 
 #include <zephyr/kernel.h>
 #include <zmk/event_manager.h>
+#include <zmk/event_pool.h>
 
 #define ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL UINT8_MAX
 
@@ -16,6 +17,10 @@ struct zmk_position_state_changed {
     uint32_t position;
     bool state;
     int64_t timestamp;
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE)
+    uint32_t trace_id;
+#endif
 };
 
 ZMK_EVENT_DECLARE(zmk_position_state_changed);
+ZMK_EVENT_POOL_DECLARE(zmk_position_state_changed);
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <zmk/behavior.h>
 #include <zmk/events/position_state_changed.h>
 
 #define ZMK_LAYER_CHILD_LEN_PLUS_ONE(node) 1 +
@@ -27,6 +28,18 @@ const char *zmk_keymap_layer_name(uint8_t layer);
 int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pressed,
                                       int64_t timestamp);
 
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE)
+
+const struct zmk_behavior_binding *zmk_keymap_get_binding(uint8_t layer, uint32_t position);
+// Changes take effect right away and are saved with the other changed settings, see
+// zmk_settings_mark_dirty().
+int zmk_keymap_set_binding(uint8_t layer, uint32_t position,
+                           const struct zmk_behavior_binding *binding);
+// Restores the binding from the devicetree keymap.
+int zmk_keymap_reset_binding(uint8_t layer, uint32_t position);
+
+#endif
+
 #define ZMK_KEYMAP_EXTRACT_BINDING(idx, drv_inst)                                                  \
     {                                                                                              \
         .behavior_dev = DEVICE_DT_NAME(DT_PHANDLE_BY_IDX(drv_inst, bindings, idx)),                \
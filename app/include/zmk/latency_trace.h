@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+
+enum zmk_latency_trace_stage {
+    // the kscan driver reported the key event
+    ZMK_LATENCY_TRACE_STAGE_KSCAN,
+    // the key event was taken from the kscan message queue
+    ZMK_LATENCY_TRACE_STAGE_MSGQ,
+    // the position event reached the keymap, after combos and hold-taps
+    ZMK_LATENCY_TRACE_STAGE_KEYMAP,
+    // a keycode event reached the HID listener
+    ZMK_LATENCY_TRACE_STAGE_HID,
+    // a HID report was handed to the USB or BLE stack
+    ZMK_LATENCY_TRACE_STAGE_REPORT,
+    ZMK_LATENCY_TRACE_STAGES,
+};
+
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE)
+
+// Starts a new trace at ZMK_LATENCY_TRACE_STAGE_KSCAN and returns its id. Ids are never 0.
+uint32_t zmk_latency_trace_begin(void);
+void zmk_latency_trace_mark(uint32_t id, enum zmk_latency_trace_stage stage);
+
+// Stages after the keymap are reached through other events, so they are marked on the trace
+// of the last position event the keymap handled.
+void zmk_latency_trace_set_current(uint32_t id);
+void zmk_latency_trace_mark_current(enum zmk_latency_trace_stage stage);
+
+void zmk_latency_trace_log(void);
+void zmk_latency_trace_reset(void);
+
+#else
+
+static inline uint32_t zmk_latency_trace_begin(void) { return 0; }
+static inline void zmk_latency_trace_mark(uint32_t id, enum zmk_latency_trace_stage stage) {}
+static inline void zmk_latency_trace_set_current(uint32_t id) {}
+static inline void zmk_latency_trace_mark_current(enum zmk_latency_trace_stage stage) {}
+static inline void zmk_latency_trace_log(void) {}
+static inline void zmk_latency_trace_reset(void) {}
+
+#endif
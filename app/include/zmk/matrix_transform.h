@@ -6,4 +6,6 @@
 
 #pragma once
 
-int32_t zmk_matrix_transform_row_column_to_position(uint32_t row, uint32_t column);
\ No newline at end of file
+int32_t zmk_matrix_transform_row_column_to_position(uint32_t row, uint32_t column);
+int zmk_matrix_transform_position_to_row_column(uint32_t position, uint32_t *row,
+                                                uint32_t *column);
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zmk/events/position_state_changed.h>
+
+#if IS_ENABLED(CONFIG_ZMK_POSITION_RECORDER)
+
+// Records a position event just before it is raised, from the kscan or split central work item.
+void zmk_position_recorder_record(const struct zmk_position_state_changed *ev);
+
+// Logs every recorded event, oldest first, in the format the kscan-mock-stream driver reads.
+void zmk_position_recorder_log(void);
+void zmk_position_recorder_clear(void);
+
+#else
+
+static inline void zmk_position_recorder_record(const struct zmk_position_state_changed *ev) {}
+static inline void zmk_position_recorder_log(void) {}
+static inline void zmk_position_recorder_clear(void) {}
+
+#endif
@@ -13,3 +13,82 @@
  * subsystem. This should typically be followed by a call to sys_reboot().
  */
 int zmk_settings_erase(void);
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/iterable_sections.h>
+#include <zephyr/sys/slist.h>
+
+struct zmk_settings_handler {
+    const char *name;
+    int (*set)(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg);
+};
+
+/**
+ * Registers @p set_cb for the settings under @p subtree.
+ *
+ * Every ZMK setting is loaded in one pass over the settings store at
+ * CONFIG_ZMK_SETTINGS_LOAD_INIT_PRIORITY, before the subsystems that own them are initialized.
+ * Handlers should only store the values, and leave applying them to the subsystem's init.
+ */
+#define ZMK_SETTINGS_HANDLER_DEFINE(_name, subtree, set_cb)                                        \
+    static const STRUCT_SECTION_ITERABLE(zmk_settings_handler,                                     \
+                                         _CONCAT(zmk_settings_handler_, _name)) = {                \
+        .name = subtree,                                                                           \
+        .set = set_cb,                                                                             \
+    }
+
+#define ZMK_SETTINGS_VALUE_MAX_LEN 32
+
+/**
+ * A setting saved through the settings writer.
+ *
+ * The value is read when the setting is written rather than when it is marked as changed, so it
+ * must point at the variable that holds the current value.
+ *
+ * Entries with a save callback write themselves instead, which lets one entry stand for a group
+ * of settings such as the changed key bindings.
+ */
+struct zmk_settings_entry {
+    const char *name;
+    const void *value;
+    size_t len;
+    int (*save)(void);
+    sys_snode_t node;
+    bool dirty;
+};
+
+#define ZMK_SETTINGS_ENTRY_DEFINE(entry, setting_name, value_ptr, value_len)                       \
+    BUILD_ASSERT((value_len) <= ZMK_SETTINGS_VALUE_MAX_LEN, "Setting value is too large");         \
+    static struct zmk_settings_entry entry = {                                                     \
+        .name = setting_name, .value = value_ptr, .len = value_len}
+
+#define ZMK_SETTINGS_ENTRY_DEFINE_SAVE(entry, setting_name, save_cb)                               \
+    static struct zmk_settings_entry entry = {.name = setting_name, .save = save_cb}
+
+struct zmk_settings_writer_stats {
+    // times a setting was marked as changed
+    uint32_t marked;
+    // marks of settings that were already waiting to be written, which cost no extra write
+    uint32_t avoided;
+    uint32_t written;
+    uint32_t failed;
+};
+
+/**
+ * Marks a setting as changed.
+ *
+ * Changed settings are written together from the low priority work queue once no setting has
+ * changed for CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE milliseconds, so a burst of changes to one
+ * setting costs a single write.
+ */
+int zmk_settings_mark_dirty(struct zmk_settings_entry *entry);
+
+/**
+ * Writes every changed setting now, from the calling thread.
+ *
+ * @note Call this before powering off, or changes still waiting for the quiet period are lost.
+ */
+int zmk_settings_flush(void);
+
+void zmk_settings_writer_get_stats(struct zmk_settings_writer_stats *stats);
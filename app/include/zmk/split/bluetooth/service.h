@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <zephyr/sys/util.h>
+
 #include <zmk/events/sensor_event.h>
 #include <zmk/sensors.h>
 
@@ -30,8 +32,26 @@ struct zmk_split_run_behavior_payload {
     char behavior_dev[ZMK_SPLIT_RUN_BEHAVIOR_DEV_LEN];
 } __packed;
 
-int zmk_split_bt_position_pressed(uint8_t position);
-int zmk_split_bt_position_released(uint8_t position);
+#define ZMK_SPLIT_POSITION_EVENT_PRESSED BIT(7)
+#define ZMK_SPLIT_POSITION_EVENT_POSITION_MASK BIT_MASK(7)
+
+// Start of a position events notification, followed by one zmk_split_position_event for each
+// key change queued while the previous notification was being sent.
+struct zmk_split_position_events_header {
+    // little endian lower 32 bits of the peripheral's uptime in milliseconds when the
+    // notification was sent. The central estimates the offset to its own uptime from it.
+    uint32_t timestamp;
+} __packed;
+
+struct zmk_split_position_event {
+    // the key position, with ZMK_SPLIT_POSITION_EVENT_PRESSED set for presses
+    uint8_t position_state;
+    // little endian milliseconds between the key change and the header timestamp
+    uint16_t age_ms;
+} __packed;
+
+int zmk_split_bt_position_pressed(uint8_t position, int64_t timestamp);
+int zmk_split_bt_position_released(uint8_t position, int64_t timestamp);
 int zmk_split_bt_sensor_triggered(uint8_t sensor_index,
                                   const struct zmk_sensor_channel_data channel_data[],
                                   size_t channel_data_size);
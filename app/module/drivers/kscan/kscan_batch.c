@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/math_extras.h>
+#include <zephyr/sys/util.h>
+
+#include <zmk/kscan_batch.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_BATCH_CALLBACKS)
+// Only the kscan device used for the keymap gets a batch callback.
+static const struct device *batch_dev;
+static zmk_kscan_batch_callback_t batch_callback;
+static zmk_kscan_position_lookup_t position_lookup;
+
+void zmk_kscan_batch_config(const struct device *dev, zmk_kscan_batch_callback_t callback,
+                            zmk_kscan_position_lookup_t lookup) {
+    batch_dev = dev;
+    batch_callback = callback;
+    position_lookup = lookup;
+}
+#endif
+
+void zmk_kscan_positions_init(const struct device *dev, struct zmk_kscan_positions *positions) {
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_DRIVER_POSITIONS)
+    if (dev != batch_dev || !position_lookup || !positions->table) {
+        return;
+    }
+
+    for (uint32_t r = 0; r < positions->rows; r++) {
+        for (uint32_t c = 0; c < positions->cols; c++) {
+            const int32_t position = position_lookup(r, c);
+
+            positions->table[r * positions->cols + c] = position <= INT16_MAX ? position : -1;
+        }
+    }
+
+    positions->ready = true;
+#endif
+}
+
+void zmk_kscan_report_changes(const struct device *dev, kscan_callback_t callback,
+                              const struct zmk_kscan_positions *positions, int64_t timestamp,
+                              const struct zmk_kscan_changes *changes, size_t len) {
+    if (len == 0) {
+        return;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_BATCH_CALLBACKS)
+    if (batch_callback && dev == batch_dev) {
+        LOG_DBG("Sending %zu changed lines from %s", len, dev->name);
+        batch_callback(dev, timestamp, changes, len, positions->ready ? positions : NULL);
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < len; i++) {
+        const struct zmk_kscan_changes *line = &changes[i];
+        uint32_t changed = line->changed;
+
+        while (changed) {
+            const int bit = u32_count_trailing_zeros(changed);
+            const uint32_t r = line->row + (line->vertical ? bit : 0);
+            const uint32_t c = line->column + (line->vertical ? 0 : bit);
+            const bool pressed = line->pressed & BIT(bit);
+
+            LOG_DBG("Sending event at %u,%u state %s", r, c, pressed ? "on" : "off");
+            callback(dev, r, c, pressed);
+
+            changed &= changed - 1;
+        }
+    }
+}
@@ -5,6 +5,7 @@
  */
 
 #include <zmk/debounce.h>
+#include <zmk/kscan_batch.h>
 
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
@@ -20,7 +21,8 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #define DT_DRV_COMPAT zmk_kscan_gpio_charlieplex
 
 #define INST_LEN(n) DT_INST_PROP_LEN(n, gpios)
-#define INST_CHARLIEPLEX_LEN(n) (INST_LEN(n) * INST_LEN(n))
+#define INST_COL_BATCHES(n) ZMK_DEBOUNCE_BATCH_COUNT(INST_LEN(n))
+#define INST_STATE_LEN(n) (INST_LEN(n) * INST_COL_BATCHES(n))
 
 #if CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS >= 0
 #define INST_DEBOUNCE_PRESS_MS(n) CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS
@@ -52,6 +54,12 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #define KSCAN_INTR_CFG_INIT(inst_idx) GPIO_DT_SPEC_GET(DT_DRV_INST(inst_idx), interrupt_gpios)
 
+#define USE_IDLE_SCAN IS_ENABLED(CONFIG_ZMK_KSCAN_CHARLIEPLEX_IDLE_SCAN)
+#define COND_IDLE_SCAN(code) COND_CODE_1(CONFIG_ZMK_KSCAN_CHARLIEPLEX_IDLE_SCAN, code, ())
+
+// The most idle scan passes, which can cover up to 70 cells.
+#define IDLE_SCAN_MAX_PASSES 8
+
 struct kscan_charlieplex_data {
     const struct device *dev;
     kscan_callback_t callback;
@@ -60,9 +68,22 @@ struct kscan_charlieplex_data {
     struct gpio_callback irq_callback;
     /**
      * Current state of the matrix as a flattened 2D array of length
-     * (config->cells.length ^2)
+     * (config->cells.len * config->col_batches). Bit i of the batch for row r holds the
+     * state of the key at column (i + ZMK_DEBOUNCE_BATCH_SIZE * batch).
      */
-    struct zmk_debounce_state *charlieplex_state;
+    struct zmk_debounce_batch *charlieplex_state;
+    /** Keys changed by the current scan, of the same length as charlieplex_state. */
+    struct zmk_kscan_changes *changes;
+    /** Keymap positions of the keys, if the driver has a position table. */
+    struct zmk_kscan_positions positions;
+#if USE_IDLE_SCAN
+    /** Set while polling with every key released. */
+    bool idle;
+    /** Number of idle scan passes, or 0 if there are too many cells to use idle scans. */
+    uint8_t idle_passes;
+    /** Array of length config->cells.len. Bit p is set if the cell is driven in idle pass p. */
+    uint8_t *idle_codes;
+#endif
 };
 
 struct kscan_gpio_list {
@@ -76,6 +97,7 @@ struct kscan_gpio_list {
 
 struct kscan_charlieplex_config {
     struct kscan_gpio_list cells;
+    size_t col_batches;
     struct zmk_debounce_config debounce_config;
     int32_t debounce_scan_period_ms;
     int32_t poll_period_ms;
@@ -84,17 +106,16 @@ struct kscan_charlieplex_config {
 };
 
 /**
- * Get the index into a matrix state array from a row and column.
+ * Get the index into a matrix state array from a row and column batch.
  * There are effectively (n) cols and (n-1) rows, but we use the full col x row space
  * as a safety measure against someone accidentally defining a transform RC at (p,p)
  */
 static int state_index(const struct kscan_charlieplex_config *config, const int row,
-                       const int col) {
+                       const int batch) {
     __ASSERT(row < config->cells.len, "Invalid row %i", row);
-    __ASSERT(col < config->cells.len, "Invalid column %i", col);
-    __ASSERT(col != row, "Invalid column row pair %i, %i", col, row);
+    __ASSERT(batch < config->col_batches, "Invalid column batch %i", batch);
 
-    return (col * config->cells.len) + row;
+    return (row * config->col_batches) + batch;
 }
 
 static int kscan_charlieplex_set_as_input(const struct gpio_dt_spec *gpio) {
@@ -202,6 +223,90 @@ static void kscan_charlieplex_irq_callback(const struct device *port, struct gpi
     k_work_reschedule(&data->work, K_NO_WAIT);
 }
 
+#if USE_IDLE_SCAN
+
+/**
+ * Give each cell a distinct code with the same number of bits set. For any two cells, there is
+ * then a bit which is set for the first and clear for the second, so driving the cells with bit p
+ * set and reading the others in each pass p covers every key.
+ */
+static void kscan_charlieplex_init_idle_scan(const struct device *dev) {
+    struct kscan_charlieplex_data *data = dev->data;
+    const struct kscan_charlieplex_config *config = dev->config;
+
+    for (int passes = 2; passes <= IDLE_SCAN_MAX_PASSES; passes++) {
+        int count = 0;
+
+        for (uint32_t code = 0; code < BIT(passes) && count < config->cells.len; code++) {
+            if (POPCOUNT(code) == passes / 2) {
+                data->idle_codes[count++] = code;
+            }
+        }
+
+        if (count == config->cells.len) {
+            data->idle_passes = passes;
+            return;
+        }
+    }
+
+    data->idle_passes = 0;
+}
+
+/**
+ * Check whether any key is pressed, by driving a group of cells at once and reading all the
+ * others in each pass.
+ *
+ * @returns false if every key is released, or true if any key is pressed or the check failed.
+ */
+static bool kscan_charlieplex_idle_scan(const struct device *dev) {
+    const struct kscan_charlieplex_data *data = dev->data;
+    const struct kscan_charlieplex_config *config = dev->config;
+
+    if (data->idle_passes == 0) {
+        return true;
+    }
+
+    for (int p = 0; p < data->idle_passes; p++) {
+        bool pressed = false;
+
+        for (int i = 0; i < config->cells.len; i++) {
+            if ((data->idle_codes[i] & BIT(p)) &&
+                kscan_charlieplex_set_as_output(&config->cells.gpios[i])) {
+                return true;
+            }
+        }
+
+#if CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BEFORE_INPUTS > 0
+        k_busy_wait(CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BEFORE_INPUTS);
+#endif
+
+        for (int i = 0; i < config->cells.len && !pressed; i++) {
+            if (!(data->idle_codes[i] & BIT(p))) {
+                pressed = gpio_pin_get_dt(&config->cells.gpios[i]) != 0;
+            }
+        }
+
+        for (int i = 0; i < config->cells.len; i++) {
+            if ((data->idle_codes[i] & BIT(p)) &&
+                kscan_charlieplex_set_as_input(&config->cells.gpios[i])) {
+                return true;
+            }
+        }
+
+        if (pressed) {
+            return true;
+        }
+
+#if CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BETWEEN_OUTPUTS > 0
+        k_busy_wait(CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BETWEEN_OUTPUTS);
+#endif
+    }
+
+    return false;
+}
+
+#endif // USE_IDLE_SCAN
+
 static void kscan_charlieplex_read_continue(const struct device *dev) {
     const struct kscan_charlieplex_config *config = dev->config;
     struct kscan_charlieplex_data *data = dev->data;
@@ -221,6 +326,10 @@ static void kscan_charlieplex_read_end(const struct device *dev) {
     } else {
         data->scan_time += config->poll_period_ms;
 
+#if USE_IDLE_SCAN
+        data->idle = true;
+#endif
+
         // Return to polling slowly.
         k_work_reschedule(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
     }
@@ -229,7 +338,9 @@ static void kscan_charlieplex_read_end(const struct device *dev) {
 static int kscan_charlieplex_read(const struct device *dev) {
     struct kscan_charlieplex_data *data = dev->data;
     const struct kscan_charlieplex_config *config = dev->config;
+    const int64_t timestamp = k_uptime_get();
     bool continue_scan = false;
+    size_t changes_len = 0;
 
     // NOTE: RR vs MATRIX: set all pins as input, in case there was a failure on a
     // previous scan, and one of the pins is still set as output
@@ -250,26 +361,35 @@ static int kscan_charlieplex_read(const struct device *dev) {
         k_busy_wait(CONFIG_ZMK_KSCAN_CHARLIEPLEX_WAIT_BEFORE_INPUTS);
 #endif
 
-        for (int col = 0; col < config->cells.len; col++) {
-            if (col == row) {
-                continue; // pin can't drive itself
+        for (int b = 0; b < config->col_batches; b++) {
+            const int first_col = b * ZMK_DEBOUNCE_BATCH_SIZE;
+            const int cols = MIN(config->cells.len - first_col, ZMK_DEBOUNCE_BATCH_SIZE);
+            uint32_t active = 0;
+
+            for (int i = 0; i < cols; i++) {
+                if (first_col + i == row) {
+                    continue; // pin can't drive itself
+                }
+                if (gpio_pin_get_dt(&config->cells.gpios[first_col + i]) > 0) {
+                    active |= BIT(i);
+                }
             }
-            const struct gpio_dt_spec *in_gpio = &config->cells.gpios[col];
-            const int index = state_index(config, row, col);
-
-            struct zmk_debounce_state *state = &data->charlieplex_state[index];
-            zmk_debounce_update(state, gpio_pin_get_dt(in_gpio), config->debounce_scan_period_ms,
-                                &config->debounce_config);
 
-            // NOTE: RR vs MATRIX: because we don't need an input/output => row/column
-            // setup, we can update in the same loop.
-            if (zmk_debounce_get_changed(state)) {
-                const bool pressed = zmk_debounce_is_pressed(state);
-
-                LOG_DBG("Sending event at %i,%i state %s", row, col, pressed ? "on" : "off");
-                data->callback(dev, row, col, pressed);
+            const int index = state_index(config, row, b);
+            struct zmk_debounce_batch *state = &data->charlieplex_state[index];
+            const uint32_t changed = zmk_debounce_batch_update(
+                state, active, config->debounce_scan_period_ms, &config->debounce_config);
+
+            if (changed) {
+                data->changes[changes_len++] = (struct zmk_kscan_changes){
+                    .row = row,
+                    .column = first_col,
+                    .changed = changed,
+                    .pressed = zmk_debounce_batch_get_pressed(state),
+                };
             }
-            continue_scan = continue_scan || zmk_debounce_is_active(state);
+
+            continue_scan = continue_scan || zmk_debounce_batch_get_active(state);
         }
 
         err = kscan_charlieplex_set_as_input(out_gpio);
@@ -281,6 +401,9 @@ static int kscan_charlieplex_read(const struct device *dev) {
 #endif
     }
 
+    zmk_kscan_report_changes(dev, data->callback, &data->positions, timestamp, data->changes,
+                             changes_len);
+
     if (continue_scan) {
         // At least one key is pressed or the debouncer has not yet decided if
         // it is pressed. Poll quickly until everything is released.
@@ -296,6 +419,17 @@ static int kscan_charlieplex_read(const struct device *dev) {
 static void kscan_charlieplex_work_handler(struct k_work *work) {
     struct k_work_delayable *dwork = CONTAINER_OF(work, struct k_work_delayable, work);
     struct kscan_charlieplex_data *data = CONTAINER_OF(dwork, struct kscan_charlieplex_data, work);
+
+#if USE_IDLE_SCAN
+    if (data->idle && !kscan_charlieplex_idle_scan(data->dev)) {
+        // Every key is still released, so there is nothing for a full scan to find.
+        kscan_charlieplex_read_end(data->dev);
+        return;
+    }
+
+    data->idle = false;
+#endif
+
     kscan_charlieplex_read(data->dev);
 }
 
@@ -306,6 +440,7 @@ static int kscan_charlieplex_configure(const struct device *dev, const kscan_cal
 
     struct kscan_charlieplex_data *data = dev->data;
     data->callback = callback;
+    zmk_kscan_positions_init(dev, &data->positions);
     return 0;
 }
 
@@ -371,6 +506,9 @@ static int kscan_charlieplex_init(const struct device *dev) {
     if (config->use_interrupt) {
         kscan_charlieplex_init_interrupt(dev);
     }
+#if USE_IDLE_SCAN
+    kscan_charlieplex_init_idle_scan(dev);
+#endif
     k_work_init_delayable(&data->work, kscan_charlieplex_work_handler);
     return 0;
 }
@@ -387,19 +525,27 @@ static const struct kscan_driver_api kscan_charlieplex_api = {
     BUILD_ASSERT(INST_DEBOUNCE_RELEASE_MS(n) <= DEBOUNCE_COUNTER_MAX,                              \
                  "ZMK_KSCAN_DEBOUNCE_RELEASE_MS or debounce-release-ms is too large");             \
                                                                                                    \
-    static struct zmk_debounce_state kscan_charlieplex_state_##n[INST_CHARLIEPLEX_LEN(n)];         \
+    static struct zmk_debounce_batch kscan_charlieplex_state_##n[INST_STATE_LEN(n)];               \
+    static struct zmk_kscan_changes kscan_charlieplex_changes_##n[INST_STATE_LEN(n)];              \
+    ZMK_KSCAN_POSITIONS_DEFINE(kscan_charlieplex_positions_##n, INST_LEN(n), INST_LEN(n))          \
+    COND_IDLE_SCAN((static uint8_t kscan_charlieplex_idle_codes_##n[INST_LEN(n)];))                \
     static const struct gpio_dt_spec kscan_charlieplex_cells_##n[] = {                             \
         LISTIFY(INST_LEN(n), KSCAN_GPIO_CFG_INIT, (, ), n)};                                       \
     static struct kscan_charlieplex_data kscan_charlieplex_data_##n = {                            \
         .charlieplex_state = kscan_charlieplex_state_##n,                                          \
-    };                                                                                             \
+        .changes = kscan_charlieplex_changes_##n,                                                  \
+        .positions = ZMK_KSCAN_POSITIONS_INIT(kscan_charlieplex_positions_##n, INST_LEN(n),        \
+                                              INST_LEN(n)),                                        \
+        COND_IDLE_SCAN((.idle_codes = kscan_charlieplex_idle_codes_##n, ))};                       \
                                                                                                    \
     static struct kscan_charlieplex_config kscan_charlieplex_config_##n = {                        \
         .cells = KSCAN_GPIO_LIST(kscan_charlieplex_cells_##n),                                     \
+        .col_batches = INST_COL_BATCHES(n),                                                        \
         .debounce_config =                                                                         \
             {                                                                                      \
                 .debounce_press_ms = INST_DEBOUNCE_PRESS_MS(n),                                    \
                 .debounce_release_ms = INST_DEBOUNCE_RELEASE_MS(n),                                \
+                .algorithm = DT_INST_ENUM_IDX(n, debounce_algorithm),                              \
             },                                                                                     \
         .debounce_scan_period_ms = DT_INST_PROP(n, debounce_scan_period_ms),                       \
         COND_ANY_POLLING((.poll_period_ms = DT_INST_PROP(n, poll_period_ms), ))                    \
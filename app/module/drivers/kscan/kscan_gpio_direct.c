@@ -13,9 +13,12 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/pm/device.h>
+#include <zephyr/sys/math_extras.h>
 #include <zephyr/sys/util.h>
+#include <string.h>
 
 #include <zmk/debounce.h>
+#include <zmk/kscan_batch.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -45,6 +48,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #define INST_INPUTS_LEN(n)                                                                         \
     COND_CODE_1(DT_INST_NODE_HAS_PROP(n, input_gpios), (DT_INST_PROP_LEN(n, input_gpios)),         \
                 (DT_INST_PROP_LEN(n, input_keys)))
+#define INST_INPUT_BATCHES(n) ZMK_DEBOUNCE_BATCH_COUNT(INST_INPUTS_LEN(n))
 
 #define KSCAN_GPIO_DIRECT_INPUT_CFG_INIT(idx, inst_idx)                                            \
     KSCAN_GPIO_GET_BY_IDX(DT_DRV_INST(inst_idx), input_gpios, idx)
@@ -67,12 +71,22 @@ struct kscan_direct_data {
 #endif
     /** Timestamp of the current or scheduled scan. */
     int64_t scan_time;
-    /** Current state of the inputs as an array of length config->inputs.len */
-    struct zmk_debounce_state *pin_state;
+    /** Levels of the inputs as of the current scan, of length config->input_batches. */
+    uint32_t *inputs_active;
+    /**
+     * Current state of the inputs as an array of length config->input_batches. Bit i of
+     * batch b holds the state of the input at index (i + ZMK_DEBOUNCE_BATCH_SIZE * b).
+     */
+    struct zmk_debounce_batch *pin_state;
+    /** Keys changed by the current scan, of length config->input_batches. */
+    struct zmk_kscan_changes *changes;
+    /** Keymap positions of the keys, if the driver has a position table. */
+    struct zmk_kscan_positions positions;
 };
 
 struct kscan_direct_config {
     struct zmk_debounce_config debounce_config;
+    size_t input_batches;
     int32_t debounce_scan_period_ms;
     int32_t poll_period_ms;
     bool toggle_mode;
@@ -149,6 +163,17 @@ static int kscan_inputs_set_flags(const struct kscan_gpio_list *inputs,
     return 0;
 }
 
+static const struct kscan_gpio *kscan_direct_get_input(const struct kscan_direct_data *data,
+                                                       const int index) {
+    for (int i = 0; i < data->inputs.len; i++) {
+        if (data->inputs.gpios[i].index == index) {
+            return &data->inputs.gpios[i];
+        }
+    }
+
+    return NULL;
+}
+
 static void kscan_direct_read_continue(const struct device *dev) {
     const struct kscan_direct_config *config = dev->config;
     struct kscan_direct_data *data = dev->data;
@@ -176,10 +201,13 @@ static void kscan_direct_read_end(const struct device *dev) {
 static int kscan_direct_read(const struct device *dev) {
     struct kscan_direct_data *data = dev->data;
     const struct kscan_direct_config *config = dev->config;
+    const int64_t timestamp = k_uptime_get();
 
     // Read the inputs.
     struct kscan_gpio_port_state state = {0};
 
+    memset(data->inputs_active, 0, config->input_batches * sizeof(uint32_t));
+
     for (int i = 0; i < data->inputs.len; i++) {
         const struct kscan_gpio *gpio = &data->inputs.gpios[i];
 
@@ -189,28 +217,49 @@ static int kscan_direct_read(const struct device *dev) {
             return active;
         }
 
-        zmk_debounce_update(&data->pin_state[gpio->index], active, config->debounce_scan_period_ms,
-                            &config->debounce_config);
+        if (active) {
+            data->inputs_active[gpio->index / ZMK_DEBOUNCE_BATCH_SIZE] |=
+                BIT(gpio->index % ZMK_DEBOUNCE_BATCH_SIZE);
+        }
     }
 
     // Process the new state.
     bool continue_scan = false;
+    size_t changes_len = 0;
+
+    for (int b = 0; b < config->input_batches; b++) {
+        struct zmk_debounce_batch *deb_state = &data->pin_state[b];
+        const uint32_t changed =
+            zmk_debounce_batch_update(deb_state, data->inputs_active[b],
+                                      config->debounce_scan_period_ms, &config->debounce_config);
+
+        if (changed) {
+            data->changes[changes_len++] = (struct zmk_kscan_changes){
+                .row = 0,
+                .column = b * ZMK_DEBOUNCE_BATCH_SIZE,
+                .changed = changed,
+                .pressed = zmk_debounce_batch_get_pressed(deb_state),
+            };
+        }
 
-    for (int i = 0; i < data->inputs.len; i++) {
-        const struct kscan_gpio *gpio = &data->inputs.gpios[i];
-        struct zmk_debounce_state *deb_state = &data->pin_state[gpio->index];
+        continue_scan = continue_scan || zmk_debounce_batch_get_active(deb_state);
+    }
 
-        if (zmk_debounce_get_changed(deb_state)) {
-            const bool pressed = zmk_debounce_is_pressed(deb_state);
+    zmk_kscan_report_changes(dev, data->callback, &data->positions, timestamp, data->changes,
+                             changes_len);
 
-            LOG_DBG("Sending event at 0,%i state %s", gpio->index, pressed ? "on" : "off");
-            data->callback(dev, 0, gpio->index, pressed);
-            if (config->toggle_mode && pressed) {
-                kscan_inputs_set_flags(&data->inputs, &gpio->spec);
+    if (config->toggle_mode) {
+        for (size_t i = 0; i < changes_len; i++) {
+            uint32_t pressed = data->changes[i].changed & data->changes[i].pressed;
+
+            while (pressed) {
+                const int index = data->changes[i].column + u32_count_trailing_zeros(pressed);
+
+                kscan_inputs_set_flags(&data->inputs, &kscan_direct_get_input(data, index)->spec);
+
+                pressed &= pressed - 1;
             }
         }
-
-        continue_scan = continue_scan || zmk_debounce_is_active(deb_state);
     }
 
     if (continue_scan) {
@@ -239,6 +288,7 @@ static int kscan_direct_configure(const struct device *dev, kscan_callback_t cal
     }
 
     data->callback = callback;
+    zmk_kscan_positions_init(dev, &data->positions);
     return 0;
 }
 
@@ -356,21 +406,30 @@ static const struct kscan_driver_api kscan_direct_api = {
                     (LISTIFY(INST_INPUTS_LEN(n), KSCAN_GPIO_DIRECT_INPUT_CFG_INIT, (, ), n)),      \
                     (LISTIFY(INST_INPUTS_LEN(n), KSCAN_KEY_DIRECT_INPUT_CFG_INIT, (, ), n)))};     \
                                                                                                    \
-    static struct zmk_debounce_state kscan_direct_state_##n[INST_INPUTS_LEN(n)];                   \
+    static uint32_t kscan_direct_inputs_active_##n[INST_INPUT_BATCHES(n)];                         \
+    static struct zmk_debounce_batch kscan_direct_state_##n[INST_INPUT_BATCHES(n)];                \
+    static struct zmk_kscan_changes kscan_direct_changes_##n[INST_INPUT_BATCHES(n)];               \
+    ZMK_KSCAN_POSITIONS_DEFINE(kscan_direct_positions_##n, 1, INST_INPUTS_LEN(n))                  \
                                                                                                    \
     COND_INTERRUPTS(                                                                               \
         (static struct kscan_direct_irq_callback kscan_direct_irqs_##n[INST_INPUTS_LEN(n)];))      \
                                                                                                    \
     static struct kscan_direct_data kscan_direct_data_##n = {                                      \
         .inputs = KSCAN_GPIO_LIST(kscan_direct_inputs_##n),                                        \
+        .inputs_active = kscan_direct_inputs_active_##n,                                           \
         .pin_state = kscan_direct_state_##n,                                                       \
+        .changes = kscan_direct_changes_##n,                                                       \
+        .positions = ZMK_KSCAN_POSITIONS_INIT(kscan_direct_positions_##n, 1,                       \
+                                              INST_INPUTS_LEN(n)),                                 \
         COND_INTERRUPTS((.irqs = kscan_direct_irqs_##n, ))};                                       \
                                                                                                    \
     static struct kscan_direct_config kscan_direct_config_##n = {                                  \
+        .input_batches = INST_INPUT_BATCHES(n),                                                    \
         .debounce_config =                                                                         \
             {                                                                                      \
                 .debounce_press_ms = INST_DEBOUNCE_PRESS_MS(n),                                    \
                 .debounce_release_ms = INST_DEBOUNCE_RELEASE_MS(n),                                \
+                .algorithm = DT_INST_ENUM_IDX(n, debounce_algorithm),                              \
             },                                                                                     \
         .debounce_scan_period_ms = DT_INST_PROP(n, debounce_scan_period_ms),                       \
         .poll_period_ms = DT_INST_PROP(n, poll_period_ms),                                         \
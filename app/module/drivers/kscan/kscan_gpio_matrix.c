@@ -15,8 +15,10 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/sys/__assert.h>
 #include <zephyr/sys/util.h>
+#include <string.h>
 
 #include <zmk/debounce.h>
+#include <zmk/kscan_batch.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -28,8 +30,10 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #define INST_ROWS_LEN(n) DT_INST_PROP_LEN(n, row_gpios)
 #define INST_COLS_LEN(n) DT_INST_PROP_LEN(n, col_gpios)
-#define INST_MATRIX_LEN(n) (INST_ROWS_LEN(n) * INST_COLS_LEN(n))
 #define INST_INPUTS_LEN(n) COND_DIODE_DIR(n, (INST_COLS_LEN(n)), (INST_ROWS_LEN(n)))
+#define INST_OUTPUTS_LEN(n) COND_DIODE_DIR(n, (INST_ROWS_LEN(n)), (INST_COLS_LEN(n)))
+#define INST_INPUT_BATCHES(n) ZMK_DEBOUNCE_BATCH_COUNT(INST_INPUTS_LEN(n))
+#define INST_STATE_LEN(n) (INST_OUTPUTS_LEN(n) * INST_INPUT_BATCHES(n))
 
 #if CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS >= 0
 #define INST_DEBOUNCE_PRESS_MS(n) CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS
@@ -78,11 +82,18 @@ struct kscan_matrix_data {
 #endif
     /** Timestamp of the current or scheduled scan. */
     int64_t scan_time;
+    /** Levels of the inputs for the output being scanned, of length config->input_batches. */
+    uint32_t *inputs_active;
     /**
      * Current state of the matrix as a flattened 2D array of length
-     * (config->rows * config->cols)
+     * (config->outputs.len * config->input_batches). Bit i of the batch for output o
+     * holds the state of the key at input (i + ZMK_DEBOUNCE_BATCH_SIZE * batch).
      */
-    struct zmk_debounce_state *matrix_state;
+    struct zmk_debounce_batch *matrix_state;
+    /** Keys changed by the current scan, of the same length as matrix_state. */
+    struct zmk_kscan_changes *changes;
+    /** Keymap positions of the keys, if the driver has a position table. */
+    struct zmk_kscan_positions positions;
 };
 
 struct kscan_matrix_config {
@@ -90,29 +101,25 @@ struct kscan_matrix_config {
     struct zmk_debounce_config debounce_config;
     size_t rows;
     size_t cols;
+    size_t input_batches;
     int32_t debounce_scan_period_ms;
     int32_t poll_period_ms;
     enum kscan_diode_direction diode_direction;
 };
 
 /**
- * Get the index into a matrix state array from a row and column.
+ * Get the index into a matrix state array from an output pin index and input batch.
  */
-static int state_index_rc(const struct kscan_matrix_config *config, const int row, const int col) {
-    __ASSERT(row < config->rows, "Invalid row %i", row);
-    __ASSERT(col < config->cols, "Invalid column %i", col);
+static int state_index(const struct kscan_matrix_config *config, const int output_idx,
+                       const int batch) {
+    __ASSERT(output_idx < config->outputs.len, "Invalid output %i", output_idx);
+    __ASSERT(batch < config->input_batches, "Invalid input batch %i", batch);
 
-    return (col * config->rows) + row;
+    return (output_idx * config->input_batches) + batch;
 }
 
-/**
- * Get the index into a matrix state array from input/output pin indices.
- */
-static int state_index_io(const struct kscan_matrix_config *config, const int input_idx,
-                          const int output_idx) {
-    return (config->diode_direction == KSCAN_ROW2COL)
-               ? state_index_rc(config, output_idx, input_idx)
-               : state_index_rc(config, input_idx, output_idx);
+static inline void set_input_active(uint32_t *inputs_active, const int input_idx) {
+    inputs_active[input_idx / ZMK_DEBOUNCE_BATCH_SIZE] |= BIT(input_idx % ZMK_DEBOUNCE_BATCH_SIZE);
 }
 
 static int kscan_matrix_set_all_outputs(const struct device *dev, const int value) {
@@ -215,9 +222,38 @@ static void kscan_matrix_read_end(const struct device *dev) {
 #endif
 }
 
+/**
+ * Read all inputs for the active output into data->inputs_active.
+ */
+static int kscan_matrix_read_inputs(const struct device *dev) {
+    struct kscan_matrix_data *data = dev->data;
+    const struct kscan_matrix_config *config = dev->config;
+
+    struct kscan_gpio_port_state state = {0};
+
+    memset(data->inputs_active, 0, config->input_batches * sizeof(uint32_t));
+
+    for (int j = 0; j < data->inputs.len; j++) {
+        const struct kscan_gpio *in_gpio = &data->inputs.gpios[j];
+
+        const int active = kscan_gpio_pin_get(in_gpio, &state);
+        if (active < 0) {
+            LOG_ERR("Failed to read port %s: %i", in_gpio->spec.port->name, active);
+            return active;
+        }
+
+        if (active) {
+            set_input_active(data->inputs_active, in_gpio->index);
+        }
+    }
+
+    return 0;
+}
+
 static int kscan_matrix_read(const struct device *dev) {
     struct kscan_matrix_data *data = dev->data;
     const struct kscan_matrix_config *config = dev->config;
+    const int64_t timestamp = k_uptime_get();
 
     // Scan the matrix.
     for (int i = 0; i < config->outputs.len; i++) {
@@ -232,20 +268,16 @@ static int kscan_matrix_read(const struct device *dev) {
 #if CONFIG_ZMK_KSCAN_MATRIX_WAIT_BEFORE_INPUTS > 0
         k_busy_wait(CONFIG_ZMK_KSCAN_MATRIX_WAIT_BEFORE_INPUTS);
 #endif
-        struct kscan_gpio_port_state state = {0};
-
-        for (int j = 0; j < data->inputs.len; j++) {
-            const struct kscan_gpio *in_gpio = &data->inputs.gpios[j];
+        err = kscan_matrix_read_inputs(dev);
+        if (err) {
+            return err;
+        }
 
-            const int index = state_index_io(config, in_gpio->index, out_gpio->index);
-            const int active = kscan_gpio_pin_get(in_gpio, &state);
-            if (active < 0) {
-                LOG_ERR("Failed to read port %s: %i", in_gpio->spec.port->name, active);
-                return active;
-            }
+        for (int b = 0; b < config->input_batches; b++) {
+            const int index = state_index(config, out_gpio->index, b);
 
-            zmk_debounce_update(&data->matrix_state[index], active, config->debounce_scan_period_ms,
-                                &config->debounce_config);
+            zmk_debounce_batch_update(&data->matrix_state[index], data->inputs_active[b],
+                                      config->debounce_scan_period_ms, &config->debounce_config);
         }
 
         err = gpio_pin_set_dt(&out_gpio->spec, 0);
@@ -260,24 +292,34 @@ static int kscan_matrix_read(const struct device *dev) {
     }
 
     // Process the new state.
+    const bool vertical = config->diode_direction == KSCAN_COL2ROW;
     bool continue_scan = false;
-
-    for (int r = 0; r < config->rows; r++) {
-        for (int c = 0; c < config->cols; c++) {
-            const int index = state_index_rc(config, r, c);
-            struct zmk_debounce_state *state = &data->matrix_state[index];
-
-            if (zmk_debounce_get_changed(state)) {
-                const bool pressed = zmk_debounce_is_pressed(state);
-
-                LOG_DBG("Sending event at %i,%i state %s", r, c, pressed ? "on" : "off");
-                data->callback(dev, r, c, pressed);
+    size_t changes_len = 0;
+
+    for (int o = 0; o < config->outputs.len; o++) {
+        for (int b = 0; b < config->input_batches; b++) {
+            const struct zmk_debounce_batch *state = &data->matrix_state[state_index(config, o, b)];
+            const uint32_t changed = zmk_debounce_batch_get_changed(state);
+
+            if (changed) {
+                const int first_input = b * ZMK_DEBOUNCE_BATCH_SIZE;
+
+                data->changes[changes_len++] = (struct zmk_kscan_changes){
+                    .row = vertical ? first_input : o,
+                    .column = vertical ? o : first_input,
+                    .vertical = vertical,
+                    .changed = changed,
+                    .pressed = zmk_debounce_batch_get_pressed(state),
+                };
             }
 
-            continue_scan = continue_scan || zmk_debounce_is_active(state);
+            continue_scan = continue_scan || zmk_debounce_batch_get_active(state);
         }
     }
 
+    zmk_kscan_report_changes(dev, data->callback, &data->positions, timestamp, data->changes,
+                             changes_len);
+
     if (continue_scan) {
         // At least one key is pressed or the debouncer has not yet decided if
         // it is pressed. Poll quickly until everything is released.
@@ -304,6 +346,7 @@ static int kscan_matrix_configure(const struct device *dev, const kscan_callback
     }
 
     data->callback = callback;
+    zmk_kscan_positions_init(dev, &data->positions);
     return 0;
 }
 
@@ -455,7 +498,10 @@ static const struct kscan_driver_api kscan_matrix_api = {
     static struct kscan_gpio kscan_matrix_cols_##n[] = {                                           \
         LISTIFY(INST_COLS_LEN(n), KSCAN_GPIO_COL_CFG_INIT, (, ), n)};                              \
                                                                                                    \
-    static struct zmk_debounce_state kscan_matrix_state_##n[INST_MATRIX_LEN(n)];                   \
+    static uint32_t kscan_matrix_inputs_active_##n[INST_INPUT_BATCHES(n)];                         \
+    static struct zmk_debounce_batch kscan_matrix_state_##n[INST_STATE_LEN(n)];                    \
+    static struct zmk_kscan_changes kscan_matrix_changes_##n[INST_STATE_LEN(n)];                   \
+    ZMK_KSCAN_POSITIONS_DEFINE(kscan_matrix_positions_##n, INST_ROWS_LEN(n), INST_COLS_LEN(n))     \
                                                                                                    \
     COND_INTERRUPTS(                                                                               \
         (static struct kscan_matrix_irq_callback kscan_matrix_irqs_##n[INST_INPUTS_LEN(n)];))      \
@@ -463,18 +509,24 @@ static const struct kscan_driver_api kscan_matrix_api = {
     static struct kscan_matrix_data kscan_matrix_data_##n = {                                      \
         .inputs =                                                                                  \
             KSCAN_GPIO_LIST(COND_DIODE_DIR(n, (kscan_matrix_cols_##n), (kscan_matrix_rows_##n))),  \
+        .inputs_active = kscan_matrix_inputs_active_##n,                                           \
         .matrix_state = kscan_matrix_state_##n,                                                    \
+        .changes = kscan_matrix_changes_##n,                                                       \
+        .positions = ZMK_KSCAN_POSITIONS_INIT(kscan_matrix_positions_##n, INST_ROWS_LEN(n),        \
+                                              INST_COLS_LEN(n)),                                   \
         COND_INTERRUPTS((.irqs = kscan_matrix_irqs_##n, ))};                                       \
                                                                                                    \
     static struct kscan_matrix_config kscan_matrix_config_##n = {                                  \
         .rows = ARRAY_SIZE(kscan_matrix_rows_##n),                                                 \
         .cols = ARRAY_SIZE(kscan_matrix_cols_##n),                                                 \
+        .input_batches = INST_INPUT_BATCHES(n),                                                    \
         .outputs =                                                                                 \
             KSCAN_GPIO_LIST(COND_DIODE_DIR(n, (kscan_matrix_rows_##n), (kscan_matrix_cols_##n))),  \
         .debounce_config =                                                                         \
             {                                                                                      \
                 .debounce_press_ms = INST_DEBOUNCE_PRESS_MS(n),                                    \
                 .debounce_release_ms = INST_DEBOUNCE_RELEASE_MS(n),                                \
+                .algorithm = DT_INST_ENUM_IDX(n, debounce_algorithm),                              \
             },                                                                                     \
         .debounce_scan_period_ms = DT_INST_PROP(n, debounce_scan_period_ms),                       \
         .poll_period_ms = DT_INST_PROP(n, poll_period_ms),                                         \
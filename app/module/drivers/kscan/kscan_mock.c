@@ -12,10 +12,22 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
+#if IS_ENABLED(CONFIG_GPIO_EMUL)
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#endif
+
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <dt-bindings/zmk/kscan_mock.h>
 
+#define INST_HAS_GPIOS(n) DT_INST_NODE_HAS_PROP(n, gpios)
+#define COND_GPIOS(n, gpios_code, callback_code)                                                   \
+    COND_CODE_1(INST_HAS_GPIOS(n), gpios_code, callback_code)
+
+#define KSCAN_MOCK_GPIO_CFG_INIT(idx, inst_idx)                                                    \
+    GPIO_DT_SPEC_GET_BY_IDX(DT_DRV_INST(inst_idx), gpios, idx)
+
 struct kscan_mock_data {
     kscan_callback_t callback;
 
@@ -31,6 +43,18 @@ static int kscan_mock_disable_callback(const struct device *dev) {
     return 0;
 }
 
+#if IS_ENABLED(CONFIG_GPIO_EMUL)
+// Sets the level another kscan driver will read from an emulated GPIO.
+static void kscan_mock_set_gpio(const struct gpio_dt_spec *gpio, const bool pressed) {
+    const bool active_low = gpio->dt_flags & GPIO_ACTIVE_LOW;
+
+    int err = gpio_emul_input_set(gpio->port, gpio->pin, pressed != active_low);
+    if (err) {
+        LOG_ERR("Failed to set pin %u on %s: %i", gpio->pin, gpio->port->name, err);
+    }
+}
+#endif
+
 static int kscan_mock_configure(const struct device *dev, kscan_callback_t callback) {
     struct kscan_mock_data *data = dev->data;
 
@@ -47,13 +71,20 @@ static int kscan_mock_configure(const struct device *dev, kscan_callback_t callb
 #define MOCK_INST_INIT(n)                                                                          \
     struct kscan_mock_config_##n {                                                                 \
         uint32_t events[DT_INST_PROP_LEN(n, events)];                                              \
+        uint32_t repeat;                                                                           \
+        bool zero_delay;                                                                           \
         bool exit_after;                                                                           \
+        COND_GPIOS(n, (struct gpio_dt_spec gpios[DT_INST_PROP_LEN(n, gpios)];), ())                \
     };                                                                                             \
     static void kscan_mock_schedule_next_event_##n(const struct device *dev) {                     \
         struct kscan_mock_data *data = dev->data;                                                  \
         const struct kscan_mock_config_##n *cfg = dev->config;                                     \
-        if (data->event_index < DT_INST_PROP_LEN(n, events)) {                                     \
-            uint32_t ev = cfg->events[data->event_index];                                          \
+        if (data->event_index < DT_INST_PROP_LEN(n, events) * cfg->repeat) {                       \
+            uint32_t ev = cfg->events[data->event_index % DT_INST_PROP_LEN(n, events)];            \
+            if (cfg->zero_delay) {                                                                 \
+                k_work_schedule(&data->work, K_NO_WAIT);                                           \
+                return;                                                                            \
+            }                                                                                      \
             LOG_DBG("delaying next keypress: %d", ZMK_MOCK_MSEC(ev));                              \
             k_work_schedule(&data->work, K_MSEC(ZMK_MOCK_MSEC(ev)));                               \
         } else if (cfg->exit_after) {                                                              \
@@ -65,10 +96,15 @@ static int kscan_mock_configure(const struct device *dev, kscan_callback_t callb
         struct k_work_delayable *d_work = k_work_delayable_from_work(work);                        \
         struct kscan_mock_data *data = CONTAINER_OF(d_work, struct kscan_mock_data, work);         \
         const struct kscan_mock_config_##n *cfg = data->dev->config;                               \
-        uint32_t ev = cfg->events[data->event_index];                                              \
-        LOG_DBG("ev %u row %d column %d state %d\n", ev, ZMK_MOCK_ROW(ev), ZMK_MOCK_COL(ev),       \
-                ZMK_MOCK_IS_PRESS(ev));                                                            \
-        data->callback(data->dev, ZMK_MOCK_ROW(ev), ZMK_MOCK_COL(ev), ZMK_MOCK_IS_PRESS(ev));      \
+        if (data->event_index < DT_INST_PROP_LEN(n, events) * cfg->repeat) {                       \
+            uint32_t ev = cfg->events[data->event_index % DT_INST_PROP_LEN(n, events)];            \
+            LOG_DBG("ev %u row %d column %d state %d\n", ev, ZMK_MOCK_ROW(ev), ZMK_MOCK_COL(ev),   \
+                    ZMK_MOCK_IS_PRESS(ev));                                                        \
+            COND_GPIOS(                                                                            \
+                n, (kscan_mock_set_gpio(&cfg->gpios[ZMK_MOCK_COL(ev)], ZMK_MOCK_IS_PRESS(ev));),   \
+                (data->callback(data->dev, ZMK_MOCK_ROW(ev), ZMK_MOCK_COL(ev),                     \
+                                ZMK_MOCK_IS_PRESS(ev));))                                          \
+        }                                                                                          \
         kscan_mock_schedule_next_event_##n(data->dev);                                             \
         data->event_index++;                                                                       \
     }                                                                                              \
@@ -76,6 +112,8 @@ static int kscan_mock_configure(const struct device *dev, kscan_callback_t callb
         struct kscan_mock_data *data = dev->data;                                                  \
         data->dev = dev;                                                                           \
         k_work_init_delayable(&data->work, kscan_mock_work_handler_##n);                           \
+        /* Another kscan driver reads the GPIOs, so nothing will enable this one. */               \
+        COND_GPIOS(n, (kscan_mock_schedule_next_event_##n(dev);), ())                              \
         return 0;                                                                                  \
     }                                                                                              \
     static int kscan_mock_enable_callback_##n(const struct device *dev) {                          \
@@ -89,7 +127,14 @@ static int kscan_mock_configure(const struct device *dev, kscan_callback_t callb
     };                                                                                             \
     static struct kscan_mock_data kscan_mock_data_##n;                                             \
     static const struct kscan_mock_config_##n kscan_mock_config_##n = {                            \
-        .events = DT_INST_PROP(n, events), .exit_after = DT_INST_PROP(n, exit_after)};             \
+        .events = DT_INST_PROP(n, events),                                                         \
+        .repeat = DT_INST_PROP(n, repeat),                                                         \
+        .zero_delay = DT_INST_PROP(n, zero_delay),                                                 \
+        .exit_after = DT_INST_PROP(n, exit_after),                                                 \
+        COND_GPIOS(n,                                                                              \
+                   (.gpios = {LISTIFY(DT_INST_PROP_LEN(n, gpios), KSCAN_MOCK_GPIO_CFG_INIT, (, ), \
+                                      n)}, ),                                                      \
+                   ())};                                                                           \
     DEVICE_DT_INST_DEFINE(n, kscan_mock_init_##n, NULL, &kscan_mock_data_##n,                      \
                           &kscan_mock_config_##n, POST_KERNEL, CONFIG_KSCAN_INIT_PRIORITY,         \
                           &mock_driver_api_##n);
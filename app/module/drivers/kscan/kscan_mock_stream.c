@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define DT_DRV_COMPAT zmk_kscan_mock_stream
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/kscan.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "cmdline.h"
+#include "soc.h"
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+/*
+ * Plays back key events read from a file or stdin, one event per line:
+ *
+ *   <timestamp ms> <d|u> <row> <column>
+ *
+ * "d" is a press and "u" a release. Timestamps only need to increase, so a trace can use
+ * the uptime of the keyboard it was recorded on. Empty lines and lines starting with "#"
+ * are skipped.
+ */
+
+#define LINE_MAX_LEN 80
+
+struct kscan_mock_stream_event {
+    int64_t timestamp;
+    uint32_t row;
+    uint32_t column;
+    bool pressed;
+};
+
+struct kscan_mock_stream_config {
+    const char *events_file;
+    uint32_t speed;
+    bool exit_after;
+};
+
+struct kscan_mock_stream_data {
+    kscan_callback_t callback;
+    const struct device *dev;
+    struct k_work_delayable work;
+
+    FILE *file;
+    const char *path;
+    uint32_t speed;
+    uint32_t line;
+    bool has_next;
+    struct kscan_mock_stream_event next;
+    // timestamp of the first event in the trace, and the uptime it was played at
+    int64_t trace_start;
+    int64_t playback_start;
+};
+
+// Command line options override the devicetree for every instance.
+static char *cmdline_events_file;
+static uint32_t cmdline_speed = UINT32_MAX;
+
+static void kscan_mock_stream_options(void) {
+    static struct args_struct_t options[] = {
+        {.option = "kscan-events",
+         .name = "path",
+         .type = 's',
+         .dest = (void *)&cmdline_events_file,
+         .descript = "File to read mock kscan events from, or - for stdin"},
+        {.option = "kscan-speed",
+         .name = "factor",
+         .type = 'u',
+         .dest = (void *)&cmdline_speed,
+         .descript = "Play mock kscan events this many times faster than recorded, "
+                     "or 0 to play them back to back"},
+        ARG_TABLE_ENDMARKER,
+    };
+
+    native_add_command_line_opts(options);
+}
+
+NATIVE_TASK(kscan_mock_stream_options, PRE_BOOT_1, 1);
+
+static bool kscan_mock_stream_parse(const char *line, struct kscan_mock_stream_event *ev) {
+    long long timestamp;
+    char state;
+
+    if (sscanf(line, "%lld %c %u %u", &timestamp, &state, &ev->row, &ev->column) != 4) {
+        return false;
+    }
+
+    if (state != 'd' && state != 'u') {
+        return false;
+    }
+
+    ev->timestamp = timestamp;
+    ev->pressed = state == 'd';
+    return true;
+}
+
+static void kscan_mock_stream_read_next(struct kscan_mock_stream_data *data) {
+    char line[LINE_MAX_LEN];
+
+    data->has_next = false;
+    while (fgets(line, sizeof(line), data->file) != NULL) {
+        data->line++;
+
+        const char *start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == '\0') {
+            continue;
+        }
+
+        if (!kscan_mock_stream_parse(start, &data->next)) {
+            LOG_WRN("Skipping invalid event on line %u of %s", data->line, data->path);
+            continue;
+        }
+
+        data->has_next = true;
+        return;
+    }
+}
+
+static void kscan_mock_stream_schedule_next(struct kscan_mock_stream_data *data) {
+    const struct kscan_mock_stream_config *cfg = data->dev->config;
+
+    if (!data->has_next) {
+        LOG_DBG("Finished playing %s", data->path);
+        // Exit from the next run of the work item, after the last event has been processed.
+        if (cfg->exit_after) {
+            k_work_schedule(&data->work, K_NO_WAIT);
+        }
+        return;
+    }
+
+    if (data->speed == 0) {
+        k_work_schedule(&data->work, K_NO_WAIT);
+        return;
+    }
+
+    // Scheduling against the start of playback keeps rounding from adding up over long traces.
+    int64_t due = data->playback_start + (data->next.timestamp - data->trace_start) / data->speed;
+    k_work_schedule(&data->work, K_MSEC(MAX(due - k_uptime_get(), 0)));
+}
+
+static void kscan_mock_stream_work_handler(struct k_work *work) {
+    struct k_work_delayable *d_work = k_work_delayable_from_work(work);
+    struct kscan_mock_stream_data *data =
+        CONTAINER_OF(d_work, struct kscan_mock_stream_data, work);
+
+    if (!data->has_next) {
+        exit(0);
+    }
+
+    struct kscan_mock_stream_event ev = data->next;
+
+    LOG_DBG("row %u column %u state %d", ev.row, ev.column, ev.pressed);
+    data->callback(data->dev, ev.row, ev.column, ev.pressed);
+
+    kscan_mock_stream_read_next(data);
+    kscan_mock_stream_schedule_next(data);
+}
+
+static int kscan_mock_stream_configure(const struct device *dev, kscan_callback_t callback) {
+    struct kscan_mock_stream_data *data = dev->data;
+
+    if (!callback) {
+        return -EINVAL;
+    }
+
+    data->callback = callback;
+    return 0;
+}
+
+static int kscan_mock_stream_enable_callback(const struct device *dev) {
+    struct kscan_mock_stream_data *data = dev->data;
+
+    if (data->file == NULL) {
+        return -ENOENT;
+    }
+
+    if (!data->has_next) {
+        kscan_mock_stream_read_next(data);
+        data->trace_start = data->next.timestamp;
+        data->playback_start = k_uptime_get();
+    }
+
+    kscan_mock_stream_schedule_next(data);
+    return 0;
+}
+
+static int kscan_mock_stream_disable_callback(const struct device *dev) {
+    struct kscan_mock_stream_data *data = dev->data;
+
+    k_work_cancel_delayable(&data->work);
+    return 0;
+}
+
+static int kscan_mock_stream_init(const struct device *dev) {
+    struct kscan_mock_stream_data *data = dev->data;
+    const struct kscan_mock_stream_config *cfg = dev->config;
+
+    data->dev = dev;
+    data->path = cmdline_events_file != NULL ? cmdline_events_file : cfg->events_file;
+    data->speed = cmdline_speed != UINT32_MAX ? cmdline_speed : cfg->speed;
+    k_work_init_delayable(&data->work, kscan_mock_stream_work_handler);
+
+    if (data->path == NULL) {
+        LOG_ERR("No events to play, set events-file or --kscan-events");
+        return -EINVAL;
+    }
+
+    data->file = strcmp(data->path, "-") == 0 ? stdin : fopen(data->path, "r");
+    if (data->file == NULL) {
+        LOG_ERR("Failed to open %s", data->path);
+        return -ENOENT;
+    }
+
+    return 0;
+}
+
+static const struct kscan_driver_api kscan_mock_stream_api = {
+    .config = kscan_mock_stream_configure,
+    .enable_callback = kscan_mock_stream_enable_callback,
+    .disable_callback = kscan_mock_stream_disable_callback,
+};
+
+#define MOCK_STREAM_INST_INIT(n)                                                                   \
+    static struct kscan_mock_stream_data kscan_mock_stream_data_##n;                               \
+    static const struct kscan_mock_stream_config kscan_mock_stream_config_##n = {                  \
+        .events_file = DT_INST_PROP_OR(n, events_file, NULL),                                      \
+        .speed = DT_INST_PROP(n, speed),                                                           \
+        .exit_after = DT_INST_PROP(n, exit_after),                                                 \
+    };                                                                                             \
+    DEVICE_DT_INST_DEFINE(n, kscan_mock_stream_init, NULL, &kscan_mock_stream_data_##n,            \
+                          &kscan_mock_stream_config_##n, POST_KERNEL, CONFIG_KSCAN_INIT_PRIORITY,  \
+                          &kscan_mock_stream_api);
+
+DT_INST_FOREACH_STATUS_OKAY(MOCK_STREAM_INST_INIT)
@@ -19,11 +19,31 @@ struct zmk_debounce_state {
     uint16_t counter : DEBOUNCE_COUNTER_BITS;
 };
 
+/** Values match the order of the debounce-algorithm devicetree property. */
+enum zmk_debounce_algorithm {
+    /**
+     * A switch latches as pressed or released once it has been in that state for the debounce
+     * time, counting time spent bouncing back against it.
+     */
+    ZMK_DEBOUNCE_INTEGRATOR,
+    /**
+     * A switch latches as pressed as soon as it reads as pressed, and latches as released like
+     * with ZMK_DEBOUNCE_INTEGRATOR. debounce_press_ms is not used.
+     */
+    ZMK_DEBOUNCE_EAGER_PRESS,
+    /**
+     * A switch latches as soon as it reads as pressed or released, then ignores its input for the
+     * debounce time of the new state, so the bounces after each edge are not reported.
+     */
+    ZMK_DEBOUNCE_EAGER,
+};
+
 struct zmk_debounce_config {
     /** Duration a switch must be pressed to latch as pressed. */
     uint32_t debounce_press_ms;
     /** Duration a switch must be released to latch as released. */
     uint32_t debounce_release_ms;
+    enum zmk_debounce_algorithm algorithm;
 };
 
 /**
@@ -54,3 +74,56 @@ bool zmk_debounce_is_pressed(const struct zmk_debounce_state *state);
  * debounce_update.
  */
 bool zmk_debounce_get_changed(const struct zmk_debounce_state *state);
+
+/** Number of switches debounced together by one zmk_debounce_batch. */
+#define ZMK_DEBOUNCE_BATCH_SIZE 32
+
+/** Number of zmk_debounce_batch needed to debounce len switches. */
+#define ZMK_DEBOUNCE_BATCH_COUNT(len) DIV_ROUND_UP(len, ZMK_DEBOUNCE_BATCH_SIZE)
+
+/**
+ * State for up to ZMK_DEBOUNCE_BATCH_SIZE switches, where bit i of each word refers to switch i.
+ *
+ * The counters are stored as bit-planes: bit i of counter[b] is bit b of the counter for
+ * switch i. This lets zmk_debounce_batch_update() update every switch in the batch with a
+ * fixed number of word-wide operations.
+ */
+struct zmk_debounce_batch {
+    uint32_t pressed;
+    uint32_t changed;
+    uint32_t counter[DEBOUNCE_COUNTER_BITS];
+};
+
+/**
+ * Debounces a batch of switches. This gives the same results as calling
+ * zmk_debounce_update() for each switch in the batch.
+ *
+ * @param batch The state for the switches to debounce.
+ * @param active Bit mask of the switches which are currently pressed.
+ * @param elapsed_ms Time elapsed since the previous update in milliseconds.
+ * @param config Debounce settings.
+ *
+ * @returns a bit mask of the switches whose pressed state changed.
+ */
+uint32_t zmk_debounce_batch_update(struct zmk_debounce_batch *batch, const uint32_t active,
+                                   const int elapsed_ms, const struct zmk_debounce_config *config);
+
+/**
+ * @returns a bit mask of the switches for which zmk_debounce_is_active() would return true.
+ */
+uint32_t zmk_debounce_batch_get_active(const struct zmk_debounce_batch *batch);
+
+/**
+ * @returns a bit mask of the switches which are latched as pressed.
+ */
+static inline uint32_t zmk_debounce_batch_get_pressed(const struct zmk_debounce_batch *batch) {
+    return batch->pressed;
+}
+
+/**
+ * @returns a bit mask of the switches whose pressed state changed in the last call to
+ * zmk_debounce_batch_update().
+ */
+static inline uint32_t zmk_debounce_batch_get_changed(const struct zmk_debounce_batch *batch) {
+    return batch->changed;
+}
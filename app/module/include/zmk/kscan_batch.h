@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/kscan.h>
+
+/**
+ * Keys along one row or column of a kscan device whose state changed during a scan.
+ * Bit i of each mask refers to the key i columns right of (row, column), or i rows below it
+ * if vertical is set.
+ */
+struct zmk_kscan_changes {
+    uint16_t row;
+    uint16_t column;
+    bool vertical;
+    /** Keys whose state changed. */
+    uint32_t changed;
+    /** Keys which are now pressed. Only bits also set in changed are meaningful. */
+    uint32_t pressed;
+};
+
+/**
+ * Keymap positions of every key of a kscan device, so drivers can hand them over with their
+ * changes instead of each event being looked up in the global matrix transform.
+ */
+struct zmk_kscan_positions {
+    /** Array of length (rows * cols) indexed by (row * cols + column), negative if unmapped. */
+    int16_t *table;
+    uint16_t rows;
+    uint16_t cols;
+    /** Set once the table has been filled in. */
+    bool ready;
+};
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_DRIVER_POSITIONS)
+#define ZMK_KSCAN_POSITIONS_DEFINE(name, _rows, _cols) static int16_t name[(_rows) * (_cols)];
+#define ZMK_KSCAN_POSITIONS_INIT(name, _rows, _cols)                                               \
+    {.table = name, .rows = (_rows), .cols = (_cols)}
+#else
+#define ZMK_KSCAN_POSITIONS_DEFINE(name, _rows, _cols)
+#define ZMK_KSCAN_POSITIONS_INIT(name, _rows, _cols) {.table = NULL}
+#endif
+
+/**
+ * Get the keymap position of a key. The key must be within the table's rows and columns.
+ */
+static inline int32_t zmk_kscan_positions_get(const struct zmk_kscan_positions *positions,
+                                              uint32_t row, uint32_t column) {
+    return positions->table[row * positions->cols + column];
+}
+
+/**
+ * Looks up the keymap position of a key, or returns a negative value if it has none.
+ */
+typedef int32_t (*zmk_kscan_position_lookup_t)(uint32_t row, uint32_t column);
+
+/**
+ * Receives every key change from one scan of a kscan device at once.
+ *
+ * @param dev The kscan device.
+ * @param timestamp Uptime in milliseconds when the scan ran.
+ * @param changes Changed keys, in the order they should be reported.
+ * @param len Number of entries in changes.
+ * @param positions Keymap positions of the device's keys, or NULL if it has no table.
+ */
+typedef void (*zmk_kscan_batch_callback_t)(const struct device *dev, int64_t timestamp,
+                                           const struct zmk_kscan_changes *changes, size_t len,
+                                           const struct zmk_kscan_positions *positions);
+
+/**
+ * Set a callback which receives all key changes from each scan of a device instead of its
+ * kscan callback. Only drivers which report through zmk_kscan_report_changes() use it, and only
+ * for the device it was set for, so wrappers such as the composite kscan still see single keys.
+ *
+ * Must be called before kscan_config(), which fills the device's position table using lookup.
+ */
+void zmk_kscan_batch_config(const struct device *dev, zmk_kscan_batch_callback_t callback,
+                            zmk_kscan_position_lookup_t lookup);
+
+/**
+ * Fill a driver's position table if the device has a batch callback. Called from the driver's
+ * kscan config function.
+ */
+void zmk_kscan_positions_init(const struct device *dev, struct zmk_kscan_positions *positions);
+
+/**
+ * Report the key changes from one scan of a device, either to its batch callback or one key
+ * at a time to the given kscan callback.
+ */
+void zmk_kscan_report_changes(const struct device *dev, kscan_callback_t callback,
+                              const struct zmk_kscan_positions *positions, int64_t timestamp,
+                              const struct zmk_kscan_changes *changes, size_t len);
@@ -6,9 +6,13 @@
 
 #include <zmk/debounce.h>
 
+static uint32_t get_press_threshold(const struct zmk_debounce_config *config) {
+    return config->algorithm == ZMK_DEBOUNCE_EAGER_PRESS ? 0 : config->debounce_press_ms;
+}
+
 static uint32_t get_threshold(const struct zmk_debounce_state *state,
                               const struct zmk_debounce_config *config) {
-    return state->pressed ? config->debounce_release_ms : config->debounce_press_ms;
+    return state->pressed ? config->debounce_release_ms : get_press_threshold(config);
 }
 
 static void increment_counter(struct zmk_debounce_state *state, const int elapsed_ms) {
@@ -27,15 +31,37 @@ static void decrement_counter(struct zmk_debounce_state *state, const int elapse
     }
 }
 
+static void update_eager(struct zmk_debounce_state *state, const bool active,
+                         const int elapsed_ms, const struct zmk_debounce_config *config) {
+    // The counter holds the time left until the switch stops ignoring its input.
+    if (state->counter > 0) {
+        decrement_counter(state, elapsed_ms);
+        return;
+    }
+
+    if (active == state->pressed) {
+        return;
+    }
+
+    state->pressed = !state->pressed;
+    state->counter = state->pressed ? config->debounce_press_ms : config->debounce_release_ms;
+    state->changed = true;
+}
+
 void zmk_debounce_update(struct zmk_debounce_state *state, const bool active, const int elapsed_ms,
                          const struct zmk_debounce_config *config) {
+    state->changed = false;
+
+    if (config->algorithm == ZMK_DEBOUNCE_EAGER) {
+        update_eager(state, active, elapsed_ms, config);
+        return;
+    }
+
     // This uses a variation of the integrator debouncing described at
     // https://www.kennethkuhn.com/electronics/debounce.c
     // Every update where "active" does not match the current state, we increment
     // a counter, otherwise we decrement it. When the counter reaches a
     // threshold, the state flips and we reset the counter.
-    state->changed = false;
-
     if (active == state->pressed) {
         decrement_counter(state, elapsed_ms);
         return;
@@ -59,4 +85,137 @@ bool zmk_debounce_is_active(const struct zmk_debounce_state *state) {
 
 bool zmk_debounce_is_pressed(const struct zmk_debounce_state *state) { return state->pressed; }
 
-bool zmk_debounce_get_changed(const struct zmk_debounce_state *state) { return state->changed; }
\ No newline at end of file
+bool zmk_debounce_get_changed(const struct zmk_debounce_state *state) { return state->changed; }
+
+// The batch functions below implement the same algorithms as zmk_debounce_update(), but on
+// counters stored as bit-planes, so each step is a ripple-carry add, subtract, or compare of a
+// constant against every counter in the batch at once.
+
+static inline uint32_t constant_plane(const uint32_t value, const int bit) {
+    return (value & BIT(bit)) ? UINT32_MAX : 0;
+}
+
+static uint32_t batch_counter_or(const struct zmk_debounce_batch *batch) {
+    uint32_t result = 0;
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+        result |= batch->counter[b];
+    }
+    return result;
+}
+
+// returns a mask of the counters which are less than value
+static uint32_t batch_counter_less_than(const struct zmk_debounce_batch *batch,
+                                        const uint32_t value) {
+    uint32_t borrow = 0;
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+        const uint32_t x = batch->counter[b];
+        const uint32_t k = constant_plane(value, b);
+        borrow = (~x & k) | (~(x ^ k) & borrow);
+    }
+    return borrow;
+}
+
+// adds value to the counters in lanes, saturating at DEBOUNCE_COUNTER_MAX
+static void batch_counter_increment(struct zmk_debounce_batch *batch, const uint32_t lanes,
+                                    const uint32_t value) {
+    uint32_t sum[DEBOUNCE_COUNTER_BITS];
+    uint32_t carry = 0;
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+        const uint32_t x = batch->counter[b];
+        const uint32_t k = constant_plane(value, b);
+        sum[b] = x ^ k ^ carry;
+        carry = (x & k) | (carry & (x ^ k));
+    }
+
+    // A carry out of the top bit means the sum is larger than DEBOUNCE_COUNTER_MAX.
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+        batch->counter[b] = (batch->counter[b] & ~lanes) | ((sum[b] | carry) & lanes);
+    }
+}
+
+// subtracts value from the counters in lanes, saturating at 0
+static void batch_counter_decrement(struct zmk_debounce_batch *batch, const uint32_t lanes,
+                                    const uint32_t value) {
+    uint32_t diff[DEBOUNCE_COUNTER_BITS];
+    uint32_t borrow = 0;
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+        const uint32_t x = batch->counter[b];
+        const uint32_t k = constant_plane(value, b);
+        diff[b] = x ^ k ^ borrow;
+        borrow = (~x & k) | (~(x ^ k) & borrow);
+    }
+
+    // A borrow out of the top bit means the counter was less than value.
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+        batch->counter[b] = (batch->counter[b] & ~lanes) | (diff[b] & ~borrow & lanes);
+    }
+}
+
+static void batch_counter_set(struct zmk_debounce_batch *batch, const uint32_t lanes,
+                              const uint32_t value) {
+    for (int b = 0; b < DEBOUNCE_COUNTER_BITS; b++) {
+        batch->counter[b] = (batch->counter[b] & ~lanes) | (constant_plane(value, b) & lanes);
+    }
+}
+
+// returns the switches to flip
+static uint32_t batch_update_integrator(struct zmk_debounce_batch *batch, const uint32_t mismatch,
+                                        const uint32_t elapsed,
+                                        const struct zmk_debounce_config *config) {
+    const uint32_t press_threshold = get_press_threshold(config);
+
+    uint32_t below_threshold = batch_counter_less_than(batch, press_threshold);
+    if (config->debounce_release_ms != press_threshold) {
+        below_threshold = (below_threshold & ~batch->pressed) |
+                          (batch_counter_less_than(batch, config->debounce_release_ms) &
+                           batch->pressed);
+    }
+
+    const uint32_t flip = mismatch & ~below_threshold;
+
+    batch_counter_decrement(batch, ~mismatch, elapsed);
+    batch_counter_increment(batch, mismatch & below_threshold, elapsed);
+    batch_counter_set(batch, flip, 0);
+
+    return flip;
+}
+
+// returns the switches to flip
+static uint32_t batch_update_eager(struct zmk_debounce_batch *batch, const uint32_t mismatch,
+                                   const uint32_t elapsed,
+                                   const struct zmk_debounce_config *config) {
+    // The counters hold the time left until each switch stops ignoring its input.
+    const uint32_t ignored = batch_counter_or(batch);
+    const uint32_t flip = mismatch & ~ignored;
+
+    batch_counter_decrement(batch, ignored, elapsed);
+    batch_counter_set(batch, flip & ~batch->pressed, config->debounce_press_ms);
+    batch_counter_set(batch, flip & batch->pressed, config->debounce_release_ms);
+
+    return flip;
+}
+
+uint32_t zmk_debounce_batch_update(struct zmk_debounce_batch *batch, const uint32_t active,
+                                   const int elapsed_ms, const struct zmk_debounce_config *config) {
+    const uint32_t mismatch = active ^ batch->pressed;
+
+    batch->changed = 0;
+
+    // Nothing changed and no counters are running, which is the case for almost every scan.
+    if (!mismatch && !batch_counter_or(batch)) {
+        return 0;
+    }
+
+    const uint32_t elapsed = CLAMP(elapsed_ms, 0, DEBOUNCE_COUNTER_MAX);
+    const uint32_t flip = (config->algorithm == ZMK_DEBOUNCE_EAGER)
+                              ? batch_update_eager(batch, mismatch, elapsed, config)
+                              : batch_update_integrator(batch, mismatch, elapsed, config);
+
+    batch->pressed ^= flip;
+    batch->changed = flip;
+    return flip;
+}
+
+uint32_t zmk_debounce_batch_get_active(const struct zmk_debounce_batch *batch) {
+    return batch->pressed | batch_counter_or(batch);
+}
@@ -0,0 +1,78 @@
+#!/bin/sh
+
+# Copyright (c) 2024 The ZMK Contributors
+# SPDX-License-Identifier: MIT
+
+if [ -z "$1" ]; then
+    echo "Usage: ./run-benchmark.sh <path to benchmark>"
+    exit 1
+fi
+
+path="$1"
+if [ $path = "all" ]; then
+    path="benchmarks"
+fi
+
+benchmarks=$(find $path -name native_posix_64.keymap -exec dirname \{\} \;)
+num_cases=$(echo "$benchmarks" | wc -l)
+if [ $num_cases -gt 1 ] || [ "$benchmarks" != "$path" ]; then
+    # Benchmarks are run one at a time so they do not compete with each other for the CPU.
+    echo "$benchmarks" | xargs -L 1 ./run-benchmark.sh
+    exit $?
+fi
+
+benchmark="$path"
+echo "Running $benchmark:"
+
+west build -d build/$benchmark -b native_posix_64 -- -DZMK_CONFIG="$(pwd)/$benchmark" > /dev/null 2>&1
+if [ $? -gt 0 ]; then
+    echo "FAILED: $benchmark did not build"
+    exit 1
+fi
+
+./build/$benchmark/zephyr/zmk.exe | sed -e "s/.*> //" | tee build/$benchmark/benchmark_full.log | grep "^benchmark " | tee build/$benchmark/benchmark.log
+# The pipeline's status is tee's, so check the results file for benchmark lines instead.
+if ! grep -q "^benchmark " build/$benchmark/benchmark.log; then
+    echo "FAILED: $benchmark produced no results"
+    exit 1
+fi
+
+# Each line of events_per_second.floor is "<minimum events/s> <result name>", where the result
+# name is the text between "benchmark " and ":" in the result line.
+floor="$benchmark/events_per_second.floor"
+if [ -f $floor ]; then
+    awk '
+        NR == FNR {
+            if ($0 ~ /^#/ || NF == 0) next
+            min = $1
+            sub(/^[0-9]+ +/, "")
+            floors[$0] = min
+            next
+        }
+        / events\/s$/ {
+            name = $0
+            sub(/^benchmark /, "", name)
+            sub(/:.*/, "", name)
+            if (!(name in floors)) next
+            found[name] = 1
+            if ($(NF - 1) + 0 < floors[name] + 0) {
+                printf "FAILED: %s ran at %s events/s, below the floor of %s\n", name, $(NF - 1), floors[name]
+                failed = 1
+            }
+        }
+        END {
+            for (name in floors) {
+                if (!(name in found)) {
+                    printf "FAILED: %s produced no events/s result\n", name
+                    failed = 1
+                }
+            }
+            exit failed
+        }
+    ' $floor build/$benchmark/benchmark.log
+    if [ $? -gt 0 ]; then
+        exit 1
+    fi
+fi
+
+exit 0
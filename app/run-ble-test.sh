@@ -64,6 +64,15 @@ if [ $? -gt 0 ]; then
     exit 1
 fi
 
+# Split tests build a ZMK peripheral from peripheral.keymap/peripheral.conf next to the central's
+if [ -e "$testcase/peripheral.keymap" ]; then
+    west build -d build/$testcase/peripheral -b nrf52_bsim -- -DKEYMAP_FILE="$(pwd)/$testcase/peripheral.keymap" -DEXTRA_CONF_FILE="$(pwd)/$testcase/peripheral.conf" > /dev/null 2>&1
+    if [ $? -gt 0 ]; then
+        echo "FAILED: $testcase peripheral did not build" | tee -a ./build/tests/pass-fail.log
+        exit 1
+    fi
+fi
+
 if [ -n "${BLE_TESTS_QUIET_OUTPUT}" ]; then
     output_dev="/dev/null"
 else
@@ -79,17 +88,31 @@ if [ -e "${start_dir}/build/$testcase/output.log" ]; then
   rm "${start_dir}/build/$testcase/output.log"
 fi
 
-central_counts=$(wc -l ${start_dir}/${testcase}/centrals.txt | cut -d' ' -f1)
+central_counts=0
+if [ -e "${start_dir}/${testcase}/centrals.txt" ]; then
+  central_counts=$(wc -l ${start_dir}/${testcase}/centrals.txt | cut -d' ' -f1)
+fi
+
+device_count=$(( 2 + central_counts ))
+
 ./${exe_name} -d=0 -s=${exe_name} | tee -a "${start_dir}/build/$testcase/output.log" > "${output_dev}" &
 ./bs_device_handbrake -s=${exe_name} -d=1 -r=10 > "${output_dev}" &
 
-cat "${start_dir}/${testcase}/centrals.txt" |
-while IFS= read -r line
-do
-  ${line} -s=${exe_name} | tee -a "${start_dir}/build/$testcase/output.log" > "${output_dev}" &
-done
+if [ -e "${start_dir}/${testcase}/centrals.txt" ]; then
+  cat "${start_dir}/${testcase}/centrals.txt" |
+  while IFS= read -r line
+  do
+    ${line} -s=${exe_name} | tee -a "${start_dir}/build/$testcase/output.log" > "${output_dev}" &
+  done
+fi
+
+if [ -e "${start_dir}/build/$testcase/peripheral" ]; then
+  cp "${start_dir}/build/$testcase/peripheral/zephyr/zmk.exe" "${exe_name}_peripheral"
+  ./${exe_name}_peripheral -d=${device_count} -s=${exe_name} | tee -a "${start_dir}/build/$testcase/output.log" > "${output_dev}" &
+  device_count=$(( device_count + 1 ))
+fi
 
-./bs_2G4_phy_v1 -s=${exe_name} -D=$(( 2 + central_counts )) -sim_length=50e6 > "${output_dev}" 2>&1
+./bs_2G4_phy_v1 -s=${exe_name} -D=${device_count} -sim_length=50e6 > "${output_dev}" 2>&1
 
 popd > /dev/null 2>&1
 
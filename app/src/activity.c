@@ -21,6 +21,11 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/pm.h>
 
 #include <zmk/activity.h>
+#include <zmk/boot_profiler.h>
+
+#if IS_ENABLED(CONFIG_SETTINGS)
+#include <zmk/settings.h>
+#endif
 
 #if IS_ENABLED(CONFIG_USB_DEVICE_STACK)
 #include <zmk/usb.h>
@@ -73,6 +78,11 @@ void activity_work_handler(struct k_work *work) {
         // Put devices in suspend power mode before sleeping
         set_state(ZMK_ACTIVITY_SLEEP);
 
+#if IS_ENABLED(CONFIG_SETTINGS)
+        // Settings still waiting for their quiet period would be lost when powering off.
+        zmk_settings_flush();
+#endif
+
         if (zmk_pm_suspend_devices() < 0) {
             LOG_ERR("Failed to suspend all the devices");
             zmk_pm_resume_devices();
@@ -104,4 +114,4 @@ ZMK_LISTENER(activity, activity_event_listener);
 ZMK_SUBSCRIPTION(activity, zmk_position_state_changed);
 ZMK_SUBSCRIPTION(activity, zmk_sensor_event);
 
-SYS_INIT(activity_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+ZMK_SYS_INIT(activity_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
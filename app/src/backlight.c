@@ -15,10 +15,12 @@
 
 #include <zmk/activity.h>
 #include <zmk/backlight.h>
+#include <zmk/settings.h>
 #include <zmk/usb.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/activity_state_changed.h>
 #include <zmk/events/usb_conn_state_changed.h>
+#include <zmk/boot_profiler.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -57,8 +59,8 @@ static int zmk_backlight_update(void) {
 }
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-static int backlight_settings_load_cb(const char *name, size_t len, settings_read_cb read_cb,
-                                      void *cb_arg, void *param) {
+static int backlight_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                                  void *cb_arg) {
     const char *next;
     if (settings_name_steq(name, "state", &next) && !next) {
         if (len != sizeof(state)) {
@@ -71,11 +73,9 @@ static int backlight_settings_load_cb(const char *name, size_t len, settings_rea
     return -ENOENT;
 }
 
-static void backlight_save_work_handler(struct k_work *work) {
-    settings_save_one("backlight/state", &state, sizeof(state));
-}
+ZMK_SETTINGS_HANDLER_DEFINE(backlight, "backlight", backlight_settings_set);
 
-static struct k_work_delayable backlight_save_work;
+ZMK_SETTINGS_ENTRY_DEFINE(backlight_state_setting, "backlight/state", &state, sizeof(state));
 #endif
 
 static int zmk_backlight_init(void) {
@@ -84,14 +84,6 @@ static int zmk_backlight_init(void) {
         return -ENODEV;
     }
 
-#if IS_ENABLED(CONFIG_SETTINGS)
-    settings_subsys_init();
-    int rc = settings_load_subtree_direct("backlight", backlight_settings_load_cb, NULL);
-    if (rc != 0) {
-        LOG_ERR("Failed to load backlight settings: %d", rc);
-    }
-    k_work_init_delayable(&backlight_save_work, backlight_save_work_handler);
-#endif
 #if IS_ENABLED(CONFIG_ZMK_BACKLIGHT_AUTO_OFF_USB)
     state.on = zmk_usb_is_powered();
 #endif
@@ -105,8 +97,7 @@ static int zmk_backlight_update_and_save(void) {
     }
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-    int ret = k_work_reschedule(&backlight_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
-    return MIN(ret, 0);
+    return zmk_settings_mark_dirty(&backlight_state_setting);
 #else
     return 0;
 #endif
@@ -189,4 +180,4 @@ ZMK_SUBSCRIPTION(backlight, zmk_activity_state_changed);
 ZMK_SUBSCRIPTION(backlight, zmk_usb_conn_state_changed);
 #endif
 
-SYS_INIT(zmk_backlight_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+ZMK_SYS_INIT(zmk_backlight_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
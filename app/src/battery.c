@@ -21,6 +21,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/events/activity_state_changed.h>
 #include <zmk/activity.h>
 #include <zmk/workqueue.h>
+#include <zmk/deferred_init.h>
 
 static uint8_t last_state_of_charge = 0;
 
@@ -174,4 +175,4 @@ ZMK_LISTENER(battery, battery_event_listener);
 
 ZMK_SUBSCRIPTION(battery, zmk_activity_state_changed);
 
-SYS_INIT(zmk_battery_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+ZMK_DEFERRED_INIT(zmk_battery_init);
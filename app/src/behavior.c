@@ -11,6 +11,7 @@
 
 #include <drivers/behavior.h>
 #include <zmk/behavior.h>
+#include <zmk/boot_profiler.h>
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
@@ -39,6 +40,12 @@ const struct device *z_impl_behavior_get_binding(const char *name) {
     return NULL;
 }
 
+int zmk_behavior_binding_resolve(struct zmk_behavior_binding *binding) {
+    binding->resolved_dev = zmk_behavior_binding_get_device(binding);
+
+    return binding->resolved_dev != NULL ? 0 : -ENODEV;
+}
+
 #if IS_ENABLED(CONFIG_LOG)
 static int check_behavior_names(void) {
     // Behavior names must be unique, but we don't have a good way to enforce this
@@ -63,5 +70,5 @@ static int check_behavior_names(void) {
     return 0;
 }
 
-SYS_INIT(check_behavior_names, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+ZMK_SYS_INIT(check_behavior_names, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
 #endif // IS_ENABLED(CONFIG_LOG)
@@ -6,6 +6,8 @@
 
 #define DT_DRV_COMPAT zmk_behavior_hold_tap
 
+#include <inttypes.h>
+
 #include <zephyr/device.h>
 #include <drivers/behavior.h>
 #include <zmk/keys.h>
@@ -19,13 +21,13 @@
 #include <zmk/events/keycode_state_changed.h>
 #include <zmk/behavior.h>
 #include <zmk/keymap.h>
+#include <zmk/boot_profiler.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
 #define ZMK_BHV_HOLD_TAP_MAX_HELD 10
-#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS 40
 
 // increase if you have keyboard with more keys.
 #define ZMK_BHV_HOLD_TAP_POSITION_NOT_USED 9999
@@ -57,6 +59,8 @@ struct behavior_hold_tap_config {
     int tapping_term_ms;
     char *hold_behavior_dev;
     char *tap_behavior_dev;
+    const struct device *hold_behavior;
+    const struct device *tap_behavior;
     int quick_tap_ms;
     int require_prior_idle_ms;
     enum flavor flavor;
@@ -98,17 +102,28 @@ enum captured_event_tag {
     ET_CODE_CHANGED,
 };
 
+// Captured events live in the event pools, see zmk/event_pool.h.
 union captured_event_data {
-    struct zmk_position_state_changed_event position;
-    struct zmk_keycode_state_changed_event keycode;
+    struct zmk_position_state_changed_event *position;
+    struct zmk_keycode_state_changed_event *keycode;
 };
 
 struct captured_event {
     enum captured_event_tag tag;
+    uint32_t seq;
     union captured_event_data data;
 };
 
-struct captured_event captured_events[ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS] = {};
+// Captured events are kept in a ring buffer, addressed by a sequence number that increases
+// with every captured event. Releases can nest (see release_captured_events), so released
+// events are marked ET_NONE and captured_events_head only moves past them afterwards.
+struct captured_event captured_events[CONFIG_ZMK_BEHAVIOR_HOLD_TAP_MAX_CAPTURED_EVENTS] = {};
+uint32_t captured_events_head = 0;
+uint32_t captured_events_tail = 0;
+// the sequence number of the first event captured by the undecided hold-tap
+uint32_t undecided_captures_start = 0;
+// the sequence number of the last captured key down event for each position
+uint32_t captured_keydown_seq[ZMK_KEYMAP_LEN] = {};
 
 // Keep track of which key was tapped most recently for the standard, if it is a hold-tap
 // a position, will be given, if not it will just be INT32_MIN
@@ -142,32 +157,42 @@ static bool is_quick_tap(struct active_hold_tap *hold_tap) {
     }
 }
 
-static int capture_event(struct captured_event *data) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        if (captured_events[i].tag == ET_NONE) {
-            captured_events[i] = *data;
-            return 0;
-        }
+static inline struct captured_event *captured_event_at(uint32_t seq) {
+    return &captured_events[seq % ARRAY_SIZE(captured_events)];
+}
+
+static int capture_event(enum captured_event_tag tag, union captured_event_data data) {
+    if (captured_events_tail - captured_events_head == ARRAY_SIZE(captured_events)) {
+        return -ENOMEM;
     }
-    return -ENOMEM;
+
+    uint32_t seq = captured_events_tail++;
+    struct captured_event *captured_event = captured_event_at(seq);
+    captured_event->tag = tag;
+    captured_event->seq = seq;
+    captured_event->data = data;
+
+    if (tag == ET_POS_CHANGED && data.position->data.state &&
+        data.position->data.position < ZMK_KEYMAP_LEN) {
+        captured_keydown_seq[data.position->data.position] = seq;
+    }
+    return 0;
 }
 
 static bool have_captured_keydown_event(uint32_t position) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        struct captured_event *ev = &captured_events[i];
-        if (ev->tag == ET_NONE) {
-            return false;
-        }
-
-        if (ev->tag != ET_POS_CHANGED) {
-            continue;
-        }
+    if (position >= ZMK_KEYMAP_LEN) {
+        return false;
+    }
 
-        if (ev->data.position.data.position == position && ev->data.position.data.state) {
-            return true;
-        }
+    // only events captured by the undecided hold-tap count
+    uint32_t seq = captured_keydown_seq[position];
+    if (seq - undecided_captures_start >= captured_events_tail - undecided_captures_start) {
+        return false;
     }
-    return false;
+
+    struct captured_event *ev = captured_event_at(seq);
+    return ev->tag == ET_POS_CHANGED && ev->seq == seq &&
+           ev->data.position->data.position == position && ev->data.position->data.state;
 }
 
 const struct zmk_listener zmk_listener_behavior_hold_tap;
@@ -177,62 +202,63 @@ static void release_captured_events() {
         return;
     }
 
-    // We use a trick to prevent copying the captured_events array.
-    //
-    // Events for different mod-tap instances are separated by a NULL pointer.
-    //
-    // The first event popped will never be caught by the next active hold-tap
-    // because to start capturing a mod-tap-key-down event must first completely
-    // go through the events queue.
+    // The events of the hold-tap that was just decided are the last ones in the buffer.
+    // Raising them may start a new undecided hold-tap, which captures the events after it
+    // again at the tail. If that hold-tap gets decided before this loop is done, its events
+    // are released by a nested call first, which keeps the original order.
     //
     // Example of this release process;
-    // [mt2_down, k1_down, k1_up, mt2_up, null, ...]
+    // [mt2_down, k1_down, k1_up, mt2_up]
     //  ^
     // mt2_down position event isn't captured because no hold-tap is active.
     // mt2_down behavior event is handled, now we have an undecided hold-tap
-    // [null, k1_down, k1_up, mt2_up, null, ...]
+    // [-, k1_down, k1_up, mt2_up]
+    //     ^
+    // k1_down is captured by the mt2 hold-tap
+    // [-, -, k1_up, mt2_up, k1_down]
     //        ^
-    // k1_down  is captured by the mt2 mod-tap
-    // !note that searches for find_captured_keydown_event by the mt2 behavior will stop at the
-    // first null encountered [mt1_down, null, k1_up, mt2_up, null, ...]
-    //                  ^
-    // k1_up event is captured by the new hold-tap:
-    // [k1_down, k1_up, null, mt2_up, null, ...]
-    //                        ^
+    // k1_up event is captured by the mt2 hold-tap
+    // [-, -, -, mt2_up, k1_down, k1_up]
+    //           ^
     // mt2_up event is not captured but causes release of mt2 behavior
-    // [k1_down, k1_up, null, null, null, ...]
-    // now mt2 will start releasing it's own captured positions.
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        struct captured_event *captured_event = &captured_events[i];
-        enum captured_event_tag tag = captured_event->tag;
-
-        if (tag == ET_NONE) {
-            return;
+    // now mt2 releases [k1_down, k1_up] in a nested call.
+    uint32_t end = captured_events_tail;
+    for (uint32_t seq = undecided_captures_start; seq != end; seq++) {
+        struct captured_event *slot = captured_event_at(seq);
+        if (slot->tag == ET_NONE) {
+            continue;
         }
 
-        captured_events[i].tag = ET_NONE;
-        if (undecided_hold_tap != NULL) {
-            k_msleep(10);
-        }
+        // the slot can be reused as soon as it is marked free, the event itself stays in its
+        // pool until it has been raised.
+        struct captured_event captured_event = *slot;
+        slot->tag = ET_NONE;
 
-        switch (tag) {
+        switch (captured_event.tag) {
         case ET_CODE_CHANGED:
             LOG_DBG("Releasing mods changed event 0x%02X %s",
-                    captured_event->data.keycode.data.keycode,
-                    (captured_event->data.keycode.data.state ? "pressed" : "released"));
-            ZMK_EVENT_RAISE_AT(captured_event->data.keycode, behavior_hold_tap);
+                    captured_event.data.keycode->data.keycode,
+                    (captured_event.data.keycode->data.state ? "pressed" : "released"));
+            ZMK_EVENT_RAISE_AT(*captured_event.data.keycode, behavior_hold_tap);
+            free_captured_zmk_keycode_state_changed(captured_event.data.keycode);
             break;
         case ET_POS_CHANGED:
             LOG_DBG("Releasing key position event for position %d %s",
-                    captured_event->data.position.data.position,
-                    (captured_event->data.position.data.state ? "pressed" : "released"));
-            ZMK_EVENT_RAISE_AT(captured_event->data.position, behavior_hold_tap);
+                    captured_event.data.position->data.position,
+                    (captured_event.data.position->data.state ? "pressed" : "released"));
+            ZMK_EVENT_RAISE_AT(*captured_event.data.position, behavior_hold_tap);
+            free_captured_zmk_position_state_changed(captured_event.data.position);
             break;
         default:
             LOG_ERR("Unhandled captured event type");
             break;
         }
     }
+
+    while (captured_events_head != captured_events_tail &&
+           captured_event_at(captured_events_head)->tag == ET_NONE) {
+        captured_events_head++;
+    }
 }
 
 static struct active_hold_tap *find_hold_tap(uint32_t position) {
@@ -397,7 +423,8 @@ static int press_hold_binding(struct active_hold_tap *hold_tap) {
     };
 
     struct zmk_behavior_binding binding = {.behavior_dev = hold_tap->config->hold_behavior_dev,
-                                           .param1 = hold_tap->param_hold};
+                                           .param1 = hold_tap->param_hold,
+                                           .resolved_dev = hold_tap->config->hold_behavior};
     return behavior_keymap_binding_pressed(&binding, event);
 }
 
@@ -408,7 +435,8 @@ static int press_tap_binding(struct active_hold_tap *hold_tap) {
     };
 
     struct zmk_behavior_binding binding = {.behavior_dev = hold_tap->config->tap_behavior_dev,
-                                           .param1 = hold_tap->param_tap};
+                                           .param1 = hold_tap->param_tap,
+                                           .resolved_dev = hold_tap->config->tap_behavior};
     store_last_hold_tapped(hold_tap);
     return behavior_keymap_binding_pressed(&binding, event);
 }
@@ -420,7 +448,8 @@ static int release_hold_binding(struct active_hold_tap *hold_tap) {
     };
 
     struct zmk_behavior_binding binding = {.behavior_dev = hold_tap->config->hold_behavior_dev,
-                                           .param1 = hold_tap->param_hold};
+                                           .param1 = hold_tap->param_hold,
+                                           .resolved_dev = hold_tap->config->hold_behavior};
     return behavior_keymap_binding_released(&binding, event);
 }
 
@@ -431,7 +460,8 @@ static int release_tap_binding(struct active_hold_tap *hold_tap) {
     };
 
     struct zmk_behavior_binding binding = {.behavior_dev = hold_tap->config->tap_behavior_dev,
-                                           .param1 = hold_tap->param_tap};
+                                           .param1 = hold_tap->param_tap,
+                                           .resolved_dev = hold_tap->config->tap_behavior};
     return behavior_keymap_binding_released(&binding, event);
 }
 
@@ -502,6 +532,11 @@ static void decide_positional_hold(struct active_hold_tap *hold_tap) {
     hold_tap->status = STATUS_TAP;
 }
 
+static void log_decision_latency(struct active_hold_tap *hold_tap) {
+    LOG_DBG("%d decided after %" PRId64 " ms", hold_tap->position,
+            k_uptime_get() - hold_tap->timestamp);
+}
+
 static void decide_hold_tap(struct active_hold_tap *hold_tap,
                             enum decision_moment decision_moment) {
     if (hold_tap->status != STATUS_UNDECIDED) {
@@ -547,6 +582,7 @@ static void decide_hold_tap(struct active_hold_tap *hold_tap,
             status_str(hold_tap->status), flavor_str(hold_tap->config->flavor),
             decision_moment_str(decision_moment));
     undecided_hold_tap = NULL;
+    log_decision_latency(hold_tap);
     press_binding(hold_tap);
     release_captured_events();
 }
@@ -582,7 +618,7 @@ static void update_hold_status_for_retro_tap(uint32_t ignore_position) {
 
 static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
                                        struct zmk_behavior_binding_event event) {
-    const struct device *dev = zmk_behavior_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_hold_tap_config *cfg = dev->config;
 
     if (undecided_hold_tap != NULL) {
@@ -601,6 +637,10 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
 
     LOG_DBG("%d new undecided hold_tap", event.position);
     undecided_hold_tap = hold_tap;
+    if (captured_events_head == captured_events_tail) {
+        captured_events_head = captured_events_tail = 0;
+    }
+    undecided_captures_start = captured_events_tail;
 
     if (is_quick_tap(hold_tap)) {
         decide_hold_tap(hold_tap, HT_QUICK_TAP);
@@ -709,11 +749,20 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
 
     LOG_DBG("%d capturing %d %s event", undecided_hold_tap->position, ev->position,
             ev->state ? "down" : "up");
-    struct captured_event capture = {
-        .tag = ET_POS_CHANGED,
-        .data = {.position = copy_raised_zmk_position_state_changed(ev)},
-    };
-    capture_event(&capture);
+    union captured_event_data capture = {.position = capture_zmk_position_state_changed(ev)};
+    if (capture.position == NULL) {
+        LOG_ERR("%d unable to capture %d, increase "
+                "CONFIG_ZMK_EVENT_POOL_POSITION_STATE_CHANGED_SIZE",
+                undecided_hold_tap->position, ev->position);
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+    if (capture_event(ET_POS_CHANGED, capture) < 0) {
+        LOG_ERR("%d unable to capture %d, increase "
+                "CONFIG_ZMK_BEHAVIOR_HOLD_TAP_MAX_CAPTURED_EVENTS",
+                undecided_hold_tap->position, ev->position);
+        free_captured_zmk_position_state_changed(capture.position);
+        return ZMK_EV_EVENT_BUBBLE;
+    }
     decide_hold_tap(undecided_hold_tap, ev->state ? HT_OTHER_KEY_DOWN : HT_OTHER_KEY_UP);
     return ZMK_EV_EVENT_CAPTURED;
 }
@@ -746,9 +795,20 @@ static int keycode_state_changed_listener(const zmk_event_t *eh) {
     // if a undecided_hold_tap is active.
     LOG_DBG("%d capturing 0x%02X %s event", undecided_hold_tap->position, ev->keycode,
             ev->state ? "down" : "up");
-    struct captured_event capture = {
-        .tag = ET_CODE_CHANGED, .data = {.keycode = copy_raised_zmk_keycode_state_changed(ev)}};
-    capture_event(&capture);
+    union captured_event_data capture = {.keycode = capture_zmk_keycode_state_changed(ev)};
+    if (capture.keycode == NULL) {
+        LOG_ERR("%d unable to capture 0x%02X, increase "
+                "CONFIG_ZMK_EVENT_POOL_KEYCODE_STATE_CHANGED_SIZE",
+                undecided_hold_tap->position, ev->keycode);
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+    if (capture_event(ET_CODE_CHANGED, capture) < 0) {
+        LOG_ERR("%d unable to capture 0x%02X, increase "
+                "CONFIG_ZMK_BEHAVIOR_HOLD_TAP_MAX_CAPTURED_EVENTS",
+                undecided_hold_tap->position, ev->keycode);
+        free_captured_zmk_keycode_state_changed(capture.keycode);
+        return ZMK_EV_EVENT_BUBBLE;
+    }
     return ZMK_EV_EVENT_CAPTURED;
 }
 
@@ -813,4 +873,23 @@ static int behavior_hold_tap_init(const struct device *dev) {
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
+static const struct device *resolve_behavior(char *behavior_dev) {
+    struct zmk_behavior_binding binding = {.behavior_dev = behavior_dev};
+    zmk_behavior_binding_resolve(&binding);
+    return binding.resolved_dev;
+}
+
+#define RESOLVE_INST(n)                                                                            \
+    behavior_hold_tap_config_##n.hold_behavior =                                                   \
+        resolve_behavior(behavior_hold_tap_config_##n.hold_behavior_dev);                          \
+    behavior_hold_tap_config_##n.tap_behavior =                                                    \
+        resolve_behavior(behavior_hold_tap_config_##n.tap_behavior_dev);
+
+static int behavior_hold_tap_resolve_bindings(void) {
+    DT_INST_FOREACH_STATUS_OKAY(RESOLVE_INST)
+    return 0;
+}
+
+ZMK_SYS_INIT(behavior_hold_tap_resolve_bindings, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 #endif /* DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT) */
@@ -10,6 +10,7 @@
 #include <zmk/behavior.h>
 #include <zmk/behavior_queue.h>
 #include <zmk/keymap.h>
+#include <zmk/boot_profiler.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -184,7 +185,7 @@ static void queue_macro(uint32_t position, const struct zmk_behavior_binding bin
 
 static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
                                     struct zmk_behavior_binding_event event) {
-    const struct device *dev = zmk_behavior_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
     struct behavior_macro_trigger_state trigger_state = {.mode = MACRO_MODE_TAP,
@@ -200,7 +201,7 @@ static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
 
 static int on_macro_binding_released(struct zmk_behavior_binding *binding,
                                      struct zmk_behavior_binding_event event) {
-    const struct device *dev = zmk_behavior_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
 
@@ -231,3 +232,17 @@ static const struct behavior_driver_api behavior_macro_driver_api = {
 DT_FOREACH_STATUS_OKAY(zmk_behavior_macro, MACRO_INST)
 DT_FOREACH_STATUS_OKAY(zmk_behavior_macro_one_param, MACRO_INST)
 DT_FOREACH_STATUS_OKAY(zmk_behavior_macro_two_param, MACRO_INST)
+
+#define RESOLVE_INST(inst)                                                                         \
+    for (int i = 0; i < behavior_macro_config_##inst.count; i++) {                                 \
+        zmk_behavior_binding_resolve(&behavior_macro_config_##inst.bindings[i]);                   \
+    }
+
+static int behavior_macro_resolve_bindings(void) {
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_macro, RESOLVE_INST)
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_macro_one_param, RESOLVE_INST)
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_macro_two_param, RESOLVE_INST)
+    return 0;
+}
+
+ZMK_SYS_INIT(behavior_macro_resolve_bindings, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
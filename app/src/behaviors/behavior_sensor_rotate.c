@@ -7,9 +7,12 @@
 #define DT_DRV_COMPAT zmk_behavior_sensor_rotate
 
 #include <zephyr/device.h>
+#include <zephyr/init.h>
 
 #include <drivers/behavior.h>
 
+#include <zmk/boot_profiler.h>
+
 #include "behavior_sensor_rotate_common.h"
 
 static const struct behavior_driver_api behavior_sensor_rotate_driver_api = {
@@ -41,3 +44,15 @@ static int behavior_sensor_rotate_init(const struct device *dev) { return 0; };
                             &behavior_sensor_rotate_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(SENSOR_ROTATE_INST)
+
+#define RESOLVE_INST(n)                                                                            \
+    zmk_behavior_binding_resolve(&behavior_sensor_rotate_config_##n.cw_binding);                   \
+    zmk_behavior_binding_resolve(&behavior_sensor_rotate_config_##n.ccw_binding);
+
+static int behavior_sensor_rotate_resolve_bindings(void) {
+    DT_INST_FOREACH_STATUS_OKAY(RESOLVE_INST)
+    return 0;
+}
+
+ZMK_SYS_INIT(behavior_sensor_rotate_resolve_bindings, APPLICATION,
+             CONFIG_APPLICATION_INIT_PRIORITY);
@@ -19,6 +19,7 @@
 #include <zmk/events/modifiers_state_changed.h>
 #include <zmk/hid.h>
 #include <zmk/keymap.h>
+#include <zmk/boot_profiler.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -97,6 +98,7 @@ static inline int press_sticky_key_behavior(struct active_sticky_key *sticky_key
         .behavior_dev = sticky_key->config->behavior.behavior_dev,
         .param1 = sticky_key->param1,
         .param2 = sticky_key->param2,
+        .resolved_dev = sticky_key->config->behavior.resolved_dev,
     };
     struct zmk_behavior_binding_event event = {
         .position = sticky_key->position,
@@ -111,6 +113,7 @@ static inline int release_sticky_key_behavior(struct active_sticky_key *sticky_k
         .behavior_dev = sticky_key->config->behavior.behavior_dev,
         .param1 = sticky_key->param1,
         .param2 = sticky_key->param2,
+        .resolved_dev = sticky_key->config->behavior.resolved_dev,
     };
     struct zmk_behavior_binding_event event = {
         .position = sticky_key->position,
@@ -141,7 +144,7 @@ static int stop_timer(struct active_sticky_key *sticky_key) {
 
 static int on_sticky_key_binding_pressed(struct zmk_behavior_binding *binding,
                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = zmk_behavior_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_binding_get_device(binding);
     const struct behavior_sticky_key_config *cfg = dev->config;
     struct active_sticky_key *sticky_key;
     sticky_key = find_sticky_key(event.position);
@@ -350,4 +353,13 @@ static struct behavior_sticky_key_data behavior_sticky_key_data;
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
+#define RESOLVE_INST(n) zmk_behavior_binding_resolve(&behavior_sticky_key_config_##n.behavior);
+
+static int behavior_sticky_key_resolve_bindings(void) {
+    DT_INST_FOREACH_STATUS_OKAY(RESOLVE_INST)
+    return 0;
+}
+
+ZMK_SYS_INIT(behavior_sticky_key_resolve_bindings, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 #endif
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+
+#include <zmk/debounce.h>
+
+#define KEYS CONFIG_ZMK_BENCHMARK_DEBOUNCE_KEYS
+#define ITERATIONS CONFIG_ZMK_BENCHMARK_DEBOUNCE_ITERATIONS
+#define BATCHES ZMK_DEBOUNCE_BATCH_COUNT(KEYS)
+#define SCANS 1024
+#define SCAN_PERIOD_MS 1
+
+static const struct zmk_debounce_config config = {
+    .debounce_press_ms = 5,
+    .debounce_release_ms = 5,
+};
+
+// Input levels for each scan, as one bit per key, the same for both debouncers.
+static uint32_t idle_scans[SCANS][BATCHES];
+static uint32_t typing_scans[SCANS][BATCHES];
+
+static struct zmk_debounce_state key_states[KEYS];
+static struct zmk_debounce_batch batch_states[BATCHES];
+
+static uint32_t xorshift(uint32_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+static inline bool scan_bit(const uint32_t *scan, int key) {
+    return scan[key / ZMK_DEBOUNCE_BATCH_SIZE] & BIT(key % ZMK_DEBOUNCE_BATCH_SIZE);
+}
+
+// A new key goes down or up every 8 scans and bounces for 3 scans after each edge.
+static void generate_typing_scans(void) {
+    uint32_t seed = 0x2545f491;
+    uint32_t held[BATCHES] = {0};
+    int bouncing = -1;
+
+    for (int s = 0; s < SCANS; s++) {
+        if (s % 8 == 0) {
+            bouncing = xorshift(&seed) % KEYS;
+            held[bouncing / ZMK_DEBOUNCE_BATCH_SIZE] ^= BIT(bouncing % ZMK_DEBOUNCE_BATCH_SIZE);
+        }
+
+        memcpy(typing_scans[s], held, sizeof(held));
+
+        if (s % 8 < 3 && (xorshift(&seed) & 1)) {
+            typing_scans[s][bouncing / ZMK_DEBOUNCE_BATCH_SIZE] ^=
+                BIT(bouncing % ZMK_DEBOUNCE_BATCH_SIZE);
+        }
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+// changes and active_scans should be the same for both debouncers
+static void report(const char *name, const char *workload, uint64_t start, uint32_t changes,
+                   uint32_t active_scans) {
+    uint64_t elapsed = now_ns() - start;
+    printk("benchmark debounce %s %s: %d keys, %d scans, %" PRIu64
+           " ns/scan, %u changes, %u active\n",
+           name, workload, KEYS, ITERATIONS * SCANS, elapsed / (ITERATIONS * SCANS), changes,
+           active_scans);
+}
+
+static void run_per_key(const char *workload, uint32_t scans[SCANS][BATCHES]) {
+    uint32_t changes = 0;
+    uint32_t active_scans = 0;
+
+    memset(key_states, 0, sizeof(key_states));
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int s = 0; s < SCANS; s++) {
+            bool active = false;
+            for (int k = 0; k < KEYS; k++) {
+                struct zmk_debounce_state *state = &key_states[k];
+
+                zmk_debounce_update(state, scan_bit(scans[s], k), SCAN_PERIOD_MS, &config);
+                changes += zmk_debounce_get_changed(state);
+                active = active || zmk_debounce_is_active(state);
+            }
+            active_scans += active;
+        }
+    }
+    report("per_key", workload, start, changes, active_scans);
+}
+
+static void run_batch(const char *workload, uint32_t scans[SCANS][BATCHES]) {
+    uint32_t changes = 0;
+    uint32_t active_scans = 0;
+
+    memset(batch_states, 0, sizeof(batch_states));
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int s = 0; s < SCANS; s++) {
+            bool active = false;
+            for (int b = 0; b < BATCHES; b++) {
+                struct zmk_debounce_batch *state = &batch_states[b];
+
+                changes += POPCOUNT(
+                    zmk_debounce_batch_update(state, scans[s][b], SCAN_PERIOD_MS, &config));
+                active = active || zmk_debounce_batch_get_active(state);
+            }
+            active_scans += active;
+        }
+    }
+    report("batch", workload, start, changes, active_scans);
+}
+
+static int debounce_benchmark(void) {
+    generate_typing_scans();
+
+    run_per_key("idle", idle_scans);
+    run_batch("idle", idle_scans);
+    run_per_key("typing", typing_scans);
+    run_batch("typing", typing_scans);
+
+    return 0;
+}
+
+SYS_INIT(debounce_benchmark, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
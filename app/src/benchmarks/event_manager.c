@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <inttypes.h>
+#include <time.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+
+#include <zmk/event_manager.h>
+
+#define SUBSCRIPTIONS CONFIG_ZMK_BENCHMARK_EVENT_MANAGER_SUBSCRIPTIONS
+#define ITERATIONS CONFIG_ZMK_BENCHMARK_EVENT_MANAGER_ITERATIONS
+
+struct zmk_benchmark_event {
+    uint32_t value;
+};
+
+ZMK_EVENT_DECLARE(zmk_benchmark_event);
+ZMK_EVENT_IMPL(zmk_benchmark_event);
+
+// Never raised, only here so the subscription table contains entries for other event types
+// that a linear scan would have to skip over.
+struct zmk_benchmark_idle_event {
+    uint32_t value;
+};
+
+ZMK_EVENT_DECLARE(zmk_benchmark_idle_event);
+ZMK_EVENT_IMPL(zmk_benchmark_idle_event);
+
+static uint32_t callback_count;
+
+static int benchmark_listener(const zmk_event_t *eh) {
+    callback_count++;
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+#define BENCHMARK_LISTENER_IMPL(mod)                                                               \
+    ZMK_LISTENER(mod, benchmark_listener);                                                         \
+    ZMK_SUBSCRIPTION(mod, zmk_benchmark_event);                                                    \
+    ZMK_SUBSCRIPTION(mod, zmk_benchmark_idle_event);
+
+#define BENCHMARK_LISTENER(n, _) BENCHMARK_LISTENER_IMPL(benchmark_##n)
+
+LISTIFY(SUBSCRIPTIONS, BENCHMARK_LISTENER, ())
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void report(const char *name, uint64_t start) {
+    uint64_t elapsed = now_ns() - start;
+    printk("benchmark event_manager %s: %d subscriptions, %d events, %" PRIu64 " ns/event\n", name,
+           SUBSCRIPTIONS, ITERATIONS, elapsed / ITERATIONS);
+}
+
+static int event_manager_benchmark(void) {
+    struct zmk_benchmark_event_event ev = {.header = {.event = &zmk_event_zmk_benchmark_event}};
+    uint64_t start;
+
+    callback_count = 0;
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        ev.data.value = i;
+        ZMK_EVENT_RAISE(ev);
+    }
+    report("raise", start);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        ev.data.value = i;
+        ZMK_EVENT_RAISE_AT(ev, benchmark_0);
+    }
+    report("raise_at", start);
+
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        ev.data.value = i;
+        ZMK_EVENT_RAISE_AFTER(ev, benchmark_0);
+    }
+    report("raise_after", start);
+
+    printk("benchmark event_manager: %u listener callbacks\n", callback_count);
+
+    return 0;
+}
+
+SYS_INIT(event_manager_benchmark, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+
+#include <dt-bindings/zmk/keys.h>
+#include <dt-bindings/zmk/kscan_mock.h>
+
+#include <zmk/matrix.h>
+#include <zmk/matrix_transform.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/position_state_changed.h>
+#include <zmk/events/keycode_state_changed.h>
+
+#define STACK_PROBE_SIZE CONFIG_ZMK_BENCHMARK_EVENT_PIPELINE_STACK_PROBE_SIZE
+#define STACK_PAINT 0xa5
+
+#define MOCK_EVENTS_LEN DT_PROP_LEN(ZMK_MATRIX_NODE_ID, events)
+#define MOCK_REPEAT DT_PROP(ZMK_MATRIX_NODE_ID, repeat)
+#define EVENTS (MOCK_EVENTS_LEN * MOCK_REPEAT)
+
+BUILD_ASSERT(DT_NODE_HAS_COMPAT(ZMK_MATRIX_NODE_ID, zmk_kscan_mock),
+             "The event pipeline benchmark needs zmk,kscan-mock as the chosen kscan");
+BUILD_ASSERT(DT_PROP(ZMK_MATRIX_NODE_ID, zero_delay) && DT_PROP(ZMK_MATRIX_NODE_ID, exit_after),
+             "The event pipeline benchmark needs a zero-delay kscan-mock with exit-after");
+
+// The same events the mock plays back, so the runs that skip the front of the pipeline see
+// the same key positions.
+static const uint32_t mock_events[] = DT_PROP(ZMK_MATRIX_NODE_ID, events);
+
+extern const struct zmk_listener zmk_listener_keymap;
+
+static uint64_t playback_start;
+static uintptr_t stack_probe;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static uint64_t report(const char *name, const char *stages, uint64_t start) {
+    uint64_t elapsed = now_ns() - start;
+    printk("benchmark event_pipeline %s (%s): %d events, %" PRIu64 " ns/event, %" PRIu64
+           " events/s\n",
+           name, stages, EVENTS, elapsed / EVENTS,
+           (uint64_t)EVENTS * NSEC_PER_SEC / MAX(elapsed, 1));
+    return elapsed;
+}
+
+static void report_stage(const char *name, uint64_t with, uint64_t without) {
+    printk("benchmark event_pipeline stage %s: %" PRId64 " ns/event\n", name,
+           ((int64_t)with - (int64_t)without) / EVENTS);
+}
+
+// Every work item is called from the same frame of the work queue thread, so filling an array
+// on the stack of one work item marks the stack that later work items use.
+static void __noinline paint_stack(void) {
+    volatile uint8_t probe[STACK_PROBE_SIZE];
+
+    for (int i = 0; i < STACK_PROBE_SIZE; i++) {
+        probe[i] = STACK_PAINT;
+    }
+
+    stack_probe = (uintptr_t)probe;
+}
+
+static void paint_stack_work_handler(struct k_work *work) { paint_stack(); }
+
+static K_WORK_DEFINE(paint_stack_work, paint_stack_work_handler);
+
+// The stack grows down, so the lowest byte that no longer holds the paint is the deepest one
+// any work item reached since the paint.
+static size_t peak_stack_use(void) {
+    volatile uint8_t *probe = (volatile uint8_t *)stack_probe;
+
+    for (int i = 0; i < STACK_PROBE_SIZE; i++) {
+        if (probe[i] != STACK_PAINT) {
+            return STACK_PROBE_SIZE - i;
+        }
+    }
+
+    return 0;
+}
+
+static void report_memory(void) {
+    size_t stack = peak_stack_use();
+    printk("benchmark event_pipeline memory: %zu bytes peak stack%s\n", stack,
+           stack == STACK_PROBE_SIZE ? " (probe overflowed)" :);
+
+#if IS_ENABLED(CONFIG_SYS_HEAP_RUNTIME_STATS) && CONFIG_HEAP_MEM_POOL_SIZE > 0
+    extern struct k_heap _system_heap;
+    struct sys_memory_stats stats;
+
+    sys_heap_runtime_stats_get(&_system_heap.heap, &stats);
+    printk("benchmark event_pipeline memory: %zu bytes peak heap\n", stats.max_allocated_bytes);
+#else
+    printk("benchmark event_pipeline memory: no system heap\n");
+#endif
+}
+
+static struct zmk_position_state_changed_event position_event(int i) {
+    uint32_t ev = mock_events[i % MOCK_EVENTS_LEN];
+
+    return (struct zmk_position_state_changed_event){
+        .header = {.event = &zmk_event_zmk_position_state_changed},
+        .data = {.source = ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL,
+                 .state = ZMK_MOCK_IS_PRESS(ev),
+                 .position = zmk_matrix_transform_row_column_to_position(ZMK_MOCK_ROW(ev),
+                                                                         ZMK_MOCK_COL(ev)),
+                 .timestamp = k_uptime_get()},
+    };
+}
+
+// Raised through the whole position event chain: combos, hold-taps, the keymap and behaviors.
+static uint64_t run_position(void) {
+    uint64_t start = now_ns();
+    for (int i = 0; i < EVENTS; i++) {
+        struct zmk_position_state_changed_event ev = position_event(i);
+        ZMK_EVENT_RAISE(ev);
+    }
+    return report("position", "combo, hold-tap, keymap, hid", start);
+}
+
+// Raised at the keymap, skipping the listeners before it.
+static uint64_t run_keymap(void) {
+    uint64_t start = now_ns();
+    for (int i = 0; i < EVENTS; i++) {
+        struct zmk_position_state_changed_event ev = position_event(i);
+        ZMK_EVENT_RAISE_AT(ev, keymap);
+    }
+    return report("keymap", "keymap, hid", start);
+}
+
+// One press and release of a letter for every two events, straight to the HID listener.
+static uint64_t run_keycode(void) {
+    uint64_t start = now_ns();
+    for (int i = 0; i < EVENTS; i++) {
+        raise_zmk_keycode_state_changed_from_encoded(A + (i / 2) % 26, !(i & 1), k_uptime_get());
+    }
+    return report("keycode", "hid", start);
+}
+
+// The mock exits the program once it has played back every event, which is the only point at
+// which the benchmark knows the playback is over.
+static void event_pipeline_report(void) {
+    uint64_t full = report("kscan", "kscan, combo, hold-tap, keymap, hid", playback_start);
+    report_memory();
+
+    uint64_t position = run_position();
+    uint64_t keymap = run_keymap();
+    uint64_t keycode = run_keycode();
+
+    report_stage("kscan", full, position);
+    report_stage("combo+hold-tap", position, keymap);
+    report_stage("keymap", keymap, keycode);
+    report_stage("hid", keycode, 0);
+}
+
+static int event_pipeline_benchmark(void) {
+    atexit(event_pipeline_report);
+
+    k_work_submit(&paint_stack_work);
+    // The kscan is enabled right after init, and its first event is handled after the paint.
+    playback_start = now_ns();
+
+    return 0;
+}
+
+SYS_INIT(event_pipeline_benchmark, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
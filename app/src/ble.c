@@ -33,9 +33,11 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/ble.h>
 #include <zmk/keys.h>
+#include <zmk/settings.h>
 #include <zmk/split/bluetooth/uuid.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/ble_active_profile_changed.h>
+#include <zmk/boot_profiler.h>
 
 #if IS_ENABLED(CONFIG_ZMK_BLE_PASSKEY_ENTRY)
 #include <zmk/events/keycode_state_changed.h>
@@ -249,16 +251,13 @@ int zmk_ble_profile_index(const bt_addr_le_t *addr) {
 }
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-static void ble_save_profile_work(struct k_work *work) {
-    settings_save_one("ble/active_profile", &active_profile, sizeof(active_profile));
-}
-
-static struct k_work_delayable ble_save_work;
+ZMK_SETTINGS_ENTRY_DEFINE(active_profile_setting, "ble/active_profile", &active_profile,
+                          sizeof(active_profile));
 #endif
 
 static int ble_save_profile(void) {
 #if IS_ENABLED(CONFIG_SETTINGS)
-    return k_work_reschedule(&ble_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
+    return zmk_settings_mark_dirty(&active_profile_setting);
 #else
     return 0;
 #endif
@@ -430,7 +429,7 @@ static int ble_profiles_handle_set(const char *name, size_t len, settings_read_c
     return 0;
 };
 
-struct settings_handler profiles_handler = {.name = "ble", .h_set = ble_profiles_handle_set};
+ZMK_SETTINGS_HANDLER_DEFINE(ble, "ble", ble_profiles_handle_set);
 #endif /* IS_ENABLED(CONFIG_SETTINGS) */
 
 static bool is_conn_active_profile(const struct bt_conn *conn) {
@@ -638,19 +637,9 @@ static int zmk_ble_init(void) {
     }
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-    settings_subsys_init();
-
-    err = settings_register(&profiles_handler);
-    if (err) {
-        LOG_ERR("Failed to setup the profile settings handler (err %d)", err);
-        return err;
-    }
-
-    k_work_init_delayable(&ble_save_work, ble_save_profile_work);
-
-    settings_load_subtree("ble");
+    // The profiles were loaded with the rest of ZMK's settings, but the Bluetooth host can only
+    // load its own settings once it is enabled.
     settings_load_subtree("bt");
-
 #endif
 
 #if IS_ENABLED(CONFIG_ZMK_BLE_CLEAR_BONDS_ON_START)
@@ -775,4 +764,4 @@ ZMK_LISTENER(zmk_ble, zmk_ble_listener);
 ZMK_SUBSCRIPTION(zmk_ble, zmk_keycode_state_changed);
 #endif /* IS_ENABLED(CONFIG_ZMK_BLE_PASSKEY_ENTRY) */
 
-SYS_INIT(zmk_ble_init, APPLICATION, CONFIG_ZMK_BLE_INIT_PRIORITY);
+ZMK_SYS_INIT(zmk_ble_init, APPLICATION, CONFIG_ZMK_BLE_INIT_PRIORITY);
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <inttypes.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/logging/log.h>
+
+#if IS_ENABLED(CONFIG_ARCH_POSIX)
+#include <time.h>
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_BOOT_PROFILER_SHELL)
+#include <zephyr/shell/shell.h>
+#endif
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/boot_profiler.h>
+
+struct boot_record {
+    const char *name;
+    enum zmk_boot_profiler_level level;
+    uint64_t start;
+    uint64_t duration;
+};
+
+// One entry per ZMK init function, then one per init level for everything else it ran, and
+// one for main() up to the first scan.
+static struct boot_record records[CONFIG_ZMK_BOOT_PROFILER_MAX_RECORDS + ZMK_BOOT_PROFILER_LEVELS +
+                                  1];
+static uint8_t count;
+static uint8_t dropped;
+static bool finished;
+
+static uint64_t level_start[ZMK_BOOT_PROFILER_LEVELS];
+static uint64_t level_end[ZMK_BOOT_PROFILER_LEVELS];
+static uint64_t scan_started;
+
+static const char *const level_names[] = {
+    [ZMK_BOOT_PROFILER_LEVEL_PRE_KERNEL_1] = "PRE_KERNEL_1",
+    [ZMK_BOOT_PROFILER_LEVEL_PRE_KERNEL_2] = "PRE_KERNEL_2",
+    [ZMK_BOOT_PROFILER_LEVEL_POST_KERNEL] = "POST_KERNEL",
+    [ZMK_BOOT_PROFILER_LEVEL_APPLICATION] = "APPLICATION",
+};
+
+// Simulated time stands still during init on native_posix, so the host clock is used there.
+// On hardware the cycle counter only starts with the system timer in PRE_KERNEL_2, which
+// makes earlier timestamps 0.
+uint64_t zmk_boot_profiler_now(void) {
+#if IS_ENABLED(CONFIG_ARCH_POSIX)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+#else
+    return k_cyc_to_ns_floor64(k_cycle_get_32());
+#endif
+}
+
+static void add_record(const char *name, enum zmk_boot_profiler_level level, uint64_t start,
+                       uint64_t duration) {
+    if (count == ARRAY_SIZE(records)) {
+        dropped++;
+        return;
+    }
+
+    records[count++] = (struct boot_record){
+        .name = name,
+        .level = level,
+        .start = start,
+        .duration = duration,
+    };
+}
+
+void zmk_boot_profiler_record(const char *name, enum zmk_boot_profiler_level level,
+                              uint64_t start) {
+    uint64_t end = zmk_boot_profiler_now();
+
+    // Leave room for the entries added when the profile ends.
+    if (count >= CONFIG_ZMK_BOOT_PROFILER_MAX_RECORDS) {
+        dropped++;
+        return;
+    }
+
+    add_record(name, level, start, end - start);
+}
+
+// Each init level is bracketed by markers at the lowest and highest priority. Init functions
+// at the same priority as a marker may run on either side of it.
+#define LEVEL_MARKERS(level)                                                                       \
+    static int boot_profiler_##level##_start(void) {                                               \
+        level_start[ZMK_BOOT_PROFILER_LEVEL_##level] = zmk_boot_profiler_now();                    \
+        return 0;                                                                                  \
+    }                                                                                              \
+    static int boot_profiler_##level##_end(void) {                                                 \
+        level_end[ZMK_BOOT_PROFILER_LEVEL_##level] = zmk_boot_profiler_now();                      \
+        return 0;                                                                                  \
+    }                                                                                              \
+    SYS_INIT(boot_profiler_##level##_start, level, 0);                                             \
+    SYS_INIT(boot_profiler_##level##_end, level, 99)
+
+LEVEL_MARKERS(PRE_KERNEL_1);
+LEVEL_MARKERS(PRE_KERNEL_2);
+LEVEL_MARKERS(POST_KERNEL);
+LEVEL_MARKERS(APPLICATION);
+
+static void sort_records(void) {
+    for (int i = 1; i < count; i++) {
+        struct boot_record record = records[i];
+        int j = i;
+        for (; j > 0 && records[j - 1].duration < record.duration; j--) {
+            records[j] = records[j - 1];
+        }
+        records[j] = record;
+    }
+}
+
+static void finish_profile(void) {
+    uint64_t in_hooks[ZMK_BOOT_PROFILER_LEVELS] = {0};
+
+    for (int i = 0; i < count; i++) {
+        in_hooks[records[i].level] += records[i].duration;
+    }
+
+    for (int level = 0; level < ZMK_BOOT_PROFILER_LEVELS; level++) {
+        uint64_t span = level_end[level] - level_start[level];
+        add_record("(devices and kernel)", level, level_start[level],
+                   span > in_hooks[level] ? span - in_hooks[level] : 0);
+    }
+
+    uint64_t main_start = level_end[ZMK_BOOT_PROFILER_LEVEL_APPLICATION];
+    add_record("(main until scan)", ZMK_BOOT_PROFILER_LEVEL_APPLICATION, main_start,
+               scan_started - main_start);
+
+    sort_records();
+    finished = true;
+}
+
+// Start times are relative to the start of PRE_KERNEL_1.
+static uint64_t since_boot(uint64_t time) {
+    return time - level_start[ZMK_BOOT_PROFILER_LEVEL_PRE_KERNEL_1];
+}
+
+void zmk_boot_profiler_log(void) {
+    if (!finished) {
+        LOG_WRN("Boot profile is not complete yet");
+        return;
+    }
+
+    LOG_INF("Boot profile, %" PRIu64 " us until the first scan:", since_boot(scan_started) / 1000);
+    for (int i = 0; i < count; i++) {
+        const struct boot_record *record = &records[i];
+        LOG_INF("%8" PRIu64 " us at %8" PRIu64 " us %-12s %s", record->duration / 1000,
+                since_boot(record->start) / 1000, level_names[record->level], record->name);
+    }
+
+    if (dropped > 0) {
+        LOG_WRN("%u init functions were not profiled, raise ZMK_BOOT_PROFILER_MAX_RECORDS",
+                dropped);
+    }
+}
+
+#if IS_ENABLED(CONFIG_ARCH_POSIX)
+// Lines in the format run-benchmark.sh collects, so CI keeps a boot profile per commit.
+static void print_benchmark(void) {
+    printk("benchmark boot total: %" PRIu64 " ns\n", since_boot(scan_started));
+    for (int i = 0; i < count; i++) {
+        printk("benchmark boot %s %s: %" PRIu64 " ns\n", level_names[records[i].level],
+               records[i].name, records[i].duration);
+    }
+}
+#endif
+
+void zmk_boot_profiler_scan_started(void) {
+    if (finished) {
+        return;
+    }
+
+    scan_started = zmk_boot_profiler_now();
+    finish_profile();
+
+#if IS_ENABLED(CONFIG_ARCH_POSIX)
+    print_benchmark();
+#else
+    zmk_boot_profiler_log();
+#endif
+}
+
+#if IS_ENABLED(CONFIG_ZMK_BOOT_PROFILER_SHELL)
+
+static int cmd_boot_profile(const struct shell *sh, size_t argc, char **argv) {
+    if (!finished) {
+        shell_error(sh, "Boot profile is not complete yet");
+        return -EAGAIN;
+    }
+
+    shell_print(sh, "%" PRIu64 " us until the first scan", since_boot(scan_started) / 1000);
+    shell_print(sh, "%11s %11s %-12s %s", "duration", "start", "level", "init");
+    for (int i = 0; i < count; i++) {
+        const struct boot_record *record = &records[i];
+        shell_print(sh, "%8" PRIu64 " us %8" PRIu64 " us %-12s %s", record->duration / 1000,
+                    since_boot(record->start) / 1000, level_names[record->level], record->name);
+    }
+
+    if (dropped > 0) {
+        shell_warn(sh, "%u init functions were not profiled", dropped);
+    }
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(boot_profile, NULL, "Time spent in each init function during boot",
+                   cmd_boot_profile);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_BOOT_PROFILER_SHELL) */
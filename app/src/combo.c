@@ -9,8 +9,11 @@
 #include <zephyr/device.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/sys/dlist.h>
+#include <zephyr/sys/math_extras.h>
 #include <zephyr/kernel.h>
 
+#include <string.h>
+
 #include <drivers/behavior.h>
 
 #include <zmk/behavior.h>
@@ -21,6 +24,7 @@
 #include <zmk/matrix.h>
 #include <zmk/keymap.h>
 #include <zmk/virtual_key_position.h>
+#include <zmk/boot_profiler.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -49,26 +53,14 @@ struct active_combo {
     // Once this array is empty, the behavior is released.
     uint32_t key_positions_pressed_count;
     struct zmk_position_state_changed_event
-        key_positions_pressed[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
-};
-
-struct combo_candidate {
-    struct combo_cfg *combo;
-    // the time after which this behavior should be removed from candidates.
-    // by keeping track of when the candidate should be cleared there is no
-    // possibility of accidental releases.
-    int64_t timeout_at;
+        *key_positions_pressed[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
 };
 
 uint32_t pressed_keys_count = 0;
-// set of keys pressed
-struct zmk_position_state_changed_event pressed_keys[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO] = {};
-// the set of candidate combos based on the currently pressed_keys
-struct combo_candidate candidates[CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY];
+// set of keys pressed, captured in the position event pool
+struct zmk_position_state_changed_event *pressed_keys[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO] = {};
 // the last candidate that was completely pressed
 struct combo_cfg *fully_pressed_combo = NULL;
-// a lookup dict that maps a key position to all combos on that position
-struct combo_cfg *combo_lookup[ZMK_KEYMAP_LEN][CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY] = {NULL};
 // combos that have been activated and still have (some) keys pressed
 // this array is always contiguous from 0.
 struct active_combo active_combos[CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS] = {NULL};
@@ -88,6 +80,197 @@ static void store_last_tapped(int64_t timestamp) {
     }
 }
 
+static bool combo_active_on_layer(struct combo_cfg *combo, uint8_t layer) {
+    if (combo->layers[0] == -1) {
+        // -1 in the first layer position is global layer scope
+        return true;
+    }
+    for (int j = 0; j < combo->layers_len; j++) {
+        if (combo->layers[j] == layer) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_quick_tap(struct combo_cfg *combo, int64_t timestamp) {
+    return (last_tapped_timestamp + combo->require_prior_idle_ms) > timestamp;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_COMBO_ENGINE_BITSET)
+
+#define COMBO_CHILD_LEN_PLUS_ONE(n) 1 +
+#define COMBOS_LEN (DT_INST_FOREACH_CHILD(0, COMBO_CHILD_LEN_PLUS_ONE) 0)
+#define COMBO_SET_WORDS DIV_ROUND_UP(COMBOS_LEN, 32)
+
+// a set of combos, bit i refers to combos[i]
+typedef uint32_t combo_set_t[COMBO_SET_WORDS];
+
+// all combos, sorted shortest-first, then by virtual-key-position.
+struct combo_cfg *combos[COMBOS_LEN];
+int combos_count = 0;
+// for each key position, the set of combos that use it
+combo_set_t position_combos[ZMK_KEYMAP_LEN];
+// for each layer, the set of combos active on it
+combo_set_t layer_combos[ZMK_KEYMAP_LAYERS_LEN];
+// the set of combos that have require-prior-idle-ms set
+combo_set_t prior_idle_combos;
+// the set of candidate combos based on the currently pressed_keys
+combo_set_t candidates;
+// the timestamp of the first key press. every candidate times out at this
+// timestamp plus its own timeout, so there is no need to store one per candidate.
+int64_t candidates_timestamp;
+
+static inline void combo_set_add(combo_set_t set, int index) {
+    set[index / 32] |= BIT(index % 32);
+}
+
+static inline void combo_set_remove(combo_set_t set, int index) {
+    set[index / 32] &= ~BIT(index % 32);
+}
+
+// returns the index of the first combo in the set at or after index from, or -1
+static int combo_set_next(const combo_set_t set, int from) {
+    for (int w = from / 32; w < COMBO_SET_WORDS; w++) {
+        uint32_t word = set[w];
+        if (w == from / 32) {
+            word &= ~BIT_MASK(from % 32);
+        }
+        if (word) {
+            return w * 32 + u32_count_trailing_zeros(word);
+        }
+    }
+    return -1;
+}
+
+static int combo_set_count(const combo_set_t set) {
+    int count = 0;
+    for (int w = 0; w < COMBO_SET_WORDS; w++) {
+        count += POPCOUNT(set[w]);
+    }
+    return count;
+}
+
+#define COMBO_SET_FOREACH(set, i)                                                                  \
+    for (int i = combo_set_next(set, 0); i >= 0; i = combo_set_next(set, i + 1))
+
+static bool combo_sorts_before(struct combo_cfg *a, struct combo_cfg *b) {
+    return a->key_position_len < b->key_position_len ||
+           (a->key_position_len == b->key_position_len &&
+            a->virtual_key_position < b->virtual_key_position);
+}
+
+// Store the combo pointer in the combos array, keeping it sorted shortest-first,
+// then by virtual-key-position. The lookup sets are built by index_combos once
+// all combos have been added, since inserting shifts the indices.
+static int initialize_combo(struct combo_cfg *new_combo) {
+    for (int i = 0; i < new_combo->key_position_len; i++) {
+        int32_t position = new_combo->key_positions[i];
+        if (position >= ZMK_KEYMAP_LEN) {
+            LOG_ERR("Unable to initialize combo, key position %d does not exist", position);
+            return -EINVAL;
+        }
+    }
+
+    int i = combos_count++;
+    while (i > 0 && combo_sorts_before(new_combo, combos[i - 1])) {
+        combos[i] = combos[i - 1];
+        i--;
+    }
+    combos[i] = new_combo;
+    return 0;
+}
+
+static void index_combos() {
+    for (int i = 0; i < combos_count; i++) {
+        struct combo_cfg *combo = combos[i];
+        for (int k = 0; k < combo->key_position_len; k++) {
+            combo_set_add(position_combos[combo->key_positions[k]], i);
+        }
+        for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+            if (combo_active_on_layer(combo, layer)) {
+                combo_set_add(layer_combos[layer], i);
+            }
+        }
+        if (combo->require_prior_idle_ms > 0) {
+            combo_set_add(prior_idle_combos, i);
+        }
+    }
+}
+
+static int setup_candidates_for_first_keypress(int32_t position, int64_t timestamp) {
+    uint8_t highest_active_layer = zmk_keymap_highest_layer_active();
+    for (int w = 0; w < COMBO_SET_WORDS; w++) {
+        candidates[w] = position_combos[position][w] & layer_combos[highest_active_layer][w];
+    }
+    COMBO_SET_FOREACH(prior_idle_combos, i) {
+        if (is_quick_tap(combos[i], timestamp)) {
+            combo_set_remove(candidates, i);
+        }
+    }
+    candidates_timestamp = timestamp;
+    return combo_set_count(candidates);
+}
+
+static int filter_candidates(int32_t position) {
+    for (int w = 0; w < COMBO_SET_WORDS; w++) {
+        candidates[w] &= position_combos[position][w];
+    }
+    return combo_set_count(candidates);
+}
+
+static int64_t first_candidate_timeout() {
+    int32_t first_timeout_ms = INT32_MAX;
+    COMBO_SET_FOREACH(candidates, i) {
+        first_timeout_ms = MIN(first_timeout_ms, combos[i]->timeout_ms);
+    }
+    if (first_timeout_ms == INT32_MAX) {
+        return LLONG_MAX;
+    }
+    return candidates_timestamp + first_timeout_ms;
+}
+
+static int filter_timed_out_candidates(int64_t timestamp) {
+    COMBO_SET_FOREACH(candidates, i) {
+        if (candidates_timestamp + combos[i]->timeout_ms <= timestamp) {
+            combo_set_remove(candidates, i);
+        }
+    }
+    int remaining_candidates = combo_set_count(candidates);
+
+    LOG_DBG(
+        "after filtering out timed out combo candidates: remaining_candidates=%d timestamp=%lld",
+        remaining_candidates, timestamp);
+
+    return remaining_candidates;
+}
+
+static int clear_candidates() {
+    int count = combo_set_count(candidates);
+    memset(candidates, 0, sizeof(candidates));
+    return count;
+}
+
+static struct combo_cfg *first_candidate() {
+    int i = combo_set_next(candidates, 0);
+    return i < 0 ? NULL : combos[i];
+}
+
+#else /* IS_ENABLED(CONFIG_ZMK_COMBO_ENGINE_BITSET) */
+
+struct combo_candidate {
+    struct combo_cfg *combo;
+    // the time after which this behavior should be removed from candidates.
+    // by keeping track of when the candidate should be cleared there is no
+    // possibility of accidental releases.
+    int64_t timeout_at;
+};
+
+// the set of candidate combos based on the currently pressed_keys
+struct combo_candidate candidates[CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY];
+// a lookup dict that maps a key position to all combos on that position
+struct combo_cfg *combo_lookup[ZMK_KEYMAP_LEN][CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY] = {NULL};
+
 // Store the combo key pointer in the combos array, one pointer for each key position
 // The combos are sorted shortest-first, then by virtual-key-position.
 static int initialize_combo(struct combo_cfg *new_combo) {
@@ -125,23 +308,6 @@ static int initialize_combo(struct combo_cfg *new_combo) {
     return 0;
 }
 
-static bool combo_active_on_layer(struct combo_cfg *combo, uint8_t layer) {
-    if (combo->layers[0] == -1) {
-        // -1 in the first layer position is global layer scope
-        return true;
-    }
-    for (int j = 0; j < combo->layers_len; j++) {
-        if (combo->layers[j] == layer) {
-            return true;
-        }
-    }
-    return false;
-}
-
-static bool is_quick_tap(struct combo_cfg *combo, int64_t timestamp) {
-    return (last_tapped_timestamp + combo->require_prior_idle_ms) > timestamp;
-}
-
 static int setup_candidates_for_first_keypress(int32_t position, int64_t timestamp) {
     int number_of_combo_candidates = 0;
     uint8_t highest_active_layer = zmk_keymap_highest_layer_active();
@@ -207,17 +373,6 @@ static int64_t first_candidate_timeout() {
     return first_timeout;
 }
 
-static inline bool candidate_is_completely_pressed(struct combo_cfg *candidate) {
-    // this code assumes set(pressed_keys) <= set(candidate->key_positions)
-    // this invariant is enforced by filter_candidates
-    // since events may have been reraised after clearing one or more slots at
-    // the start of pressed_keys (see: release_pressed_keys), we have to check
-    // that each key needed to trigger the combo was pressed, not just the last.
-    return candidate->key_position_len == pressed_keys_count;
-}
-
-static int cleanup();
-
 static int filter_timed_out_candidates(int64_t timestamp) {
     int remaining_candidates = 0;
     for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
@@ -259,12 +414,37 @@ static int clear_candidates() {
     return CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY;
 }
 
+static struct combo_cfg *first_candidate() { return candidates[0].combo; }
+
+static void index_combos() {}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_COMBO_ENGINE_BITSET) */
+
+static inline bool candidate_is_completely_pressed(struct combo_cfg *candidate) {
+    // this code assumes set(pressed_keys) <= set(candidate->key_positions)
+    // this invariant is enforced by filter_candidates
+    // since events may have been reraised after clearing one or more slots at
+    // the start of pressed_keys (see: release_pressed_keys), we have to check
+    // that each key needed to trigger the combo was pressed, not just the last.
+    return candidate->key_position_len == pressed_keys_count;
+}
+
+static int cleanup();
+
 static int capture_pressed_key(const struct zmk_position_state_changed *ev) {
-    if (pressed_keys_count == CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY) {
+    if (pressed_keys_count == ARRAY_SIZE(pressed_keys)) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    struct zmk_position_state_changed_event *captured = capture_zmk_position_state_changed(ev);
+    if (captured == NULL) {
+        LOG_ERR("combo: unable to capture position %d, increase "
+                "CONFIG_ZMK_EVENT_POOL_POSITION_STATE_CHANGED_SIZE",
+                ev->position);
         return ZMK_EV_EVENT_BUBBLE;
     }
 
-    pressed_keys[pressed_keys_count++] = copy_raised_zmk_position_state_changed(ev);
+    pressed_keys[pressed_keys_count++] = captured;
     return ZMK_EV_EVENT_CAPTURED;
 }
 
@@ -274,7 +454,7 @@ static int release_pressed_keys() {
     uint32_t count = pressed_keys_count;
     pressed_keys_count = 0;
     for (int i = 0; i < count; i++) {
-        struct zmk_position_state_changed_event *ev = &pressed_keys[i];
+        struct zmk_position_state_changed_event *ev = pressed_keys[i];
         if (i == 0) {
             LOG_DBG("combo: releasing position event %d", ev->data.position);
             ZMK_EVENT_RELEASE(*ev);
@@ -283,6 +463,8 @@ static int release_pressed_keys() {
             LOG_DBG("combo: reraising position event %d", ev->data.position);
             ZMK_EVENT_RAISE(*ev);
         }
+        // listeners that captured the event while it was raised hold their own reference
+        free_captured_zmk_position_state_changed(ev);
     }
 
     return count;
@@ -346,7 +528,7 @@ static void activate_combo(struct combo_cfg *combo) {
         return;
     }
     move_pressed_keys_to_active_combo(active_combo);
-    press_combo_behavior(combo, active_combo->key_positions_pressed[0].data.timestamp);
+    press_combo_behavior(combo, active_combo->key_positions_pressed[0]->data.timestamp);
 }
 
 static void deactivate_combo(int active_combo_index) {
@@ -372,9 +554,10 @@ static bool release_combo_key(int32_t position, int64_t timestamp) {
             if (key_released) {
                 active_combo->key_positions_pressed[i - 1] = active_combo->key_positions_pressed[i];
                 all_keys_released = false;
-            } else if (active_combo->key_positions_pressed[i].data.position != position) {
+            } else if (active_combo->key_positions_pressed[i]->data.position != position) {
                 all_keys_released = false;
             } else { // position matches
+                free_captured_zmk_position_state_changed(active_combo->key_positions_pressed[i]);
                 key_released = true;
             }
         }
@@ -421,7 +604,7 @@ static void update_timeout_task() {
 
 static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_changed *data) {
     int num_candidates;
-    if (candidates[0].combo == NULL) {
+    if (first_candidate() == NULL) {
         num_candidates = setup_candidates_for_first_keypress(data->position, data->timestamp);
         if (num_candidates == 0) {
             return ZMK_EV_EVENT_BUBBLE;
@@ -432,7 +615,7 @@ static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_
     }
     update_timeout_task();
 
-    struct combo_cfg *candidate_combo = candidates[0].combo;
+    struct combo_cfg *candidate_combo = first_candidate();
     LOG_DBG("combo: capturing position event %d", data->position);
     int ret = capture_pressed_key(data);
     switch (num_candidates) {
@@ -527,16 +710,19 @@ ZMK_SUBSCRIPTION(combo, zmk_keycode_state_changed);
         .layers_len = DT_PROP_LEN(n, layers),                                                      \
     };
 
-#define INITIALIZE_COMBO(n) initialize_combo(&combo_config_##n);
+#define INITIALIZE_COMBO(n)                                                                        \
+    zmk_behavior_binding_resolve(&combo_config_##n.behavior);                                      \
+    initialize_combo(&combo_config_##n);
 
 DT_INST_FOREACH_CHILD(0, COMBO_INST)
 
 static int combo_init(void) {
     k_work_init_delayable(&timeout_task, combo_timeout_handler);
     DT_INST_FOREACH_CHILD(0, INITIALIZE_COMBO);
+    index_combos();
     return 0;
 }
 
-SYS_INIT(combo_init, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+ZMK_SYS_INIT(combo_init, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
 
 #endif
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/deferred_init.h>
+#include <zmk/workqueue.h>
+
+static void deferred_init_work_handler(struct k_work *work) {
+    STRUCT_SECTION_FOREACH(zmk_deferred_init, entry) {
+        int ret = entry->init();
+        if (ret < 0) {
+            LOG_ERR("Deferred init %s failed (err %d)", entry->name, ret);
+        }
+    }
+
+    LOG_INF("Deferred init finished %u us after boot", k_ticks_to_us_floor32(k_uptime_ticks()));
+}
+
+static K_WORK_DEFINE(deferred_init_work, deferred_init_work_handler);
+
+void zmk_deferred_init_start(void) {
+    k_work_submit_to_queue(zmk_workqueue_lowprio_work_q(), &deferred_init_work);
+}
@@ -20,6 +20,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/event_manager.h>
 #include <zmk/events/activity_state_changed.h>
 #include <zmk/display/status_screen.h>
+#include <zmk/deferred_init.h>
 
 static const struct device *display = DEVICE_DT_GET(DT_CHOSEN(zephyr_display));
 static bool initialized = false;
@@ -138,6 +139,11 @@ int zmk_display_init() {
     return 0;
 }
 
+// Without deferred init, main() calls zmk_display_init() once the keys are being scanned.
+#if IS_ENABLED(CONFIG_ZMK_DEFERRED_INIT)
+ZMK_DEFERRED_INIT(zmk_display_init);
+#endif
+
 #if IS_ENABLED(CONFIG_ZMK_DISPLAY_BLANK_ON_IDLE)
 int display_event_handler(const zmk_event_t *eh) {
     struct zmk_activity_state_changed *ev = as_zmk_activity_state_changed(eh);
@@ -6,10 +6,12 @@
 
 #include <zephyr/init.h>
 #include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
 
 #include <stdio.h>
 
 #include <zmk/ble.h>
+#include <zmk/settings.h>
 #include <zmk/endpoints.h>
 #include <zmk/hid.h>
 #include <dt-bindings/zmk/hid_usage_pages.h>
@@ -19,6 +21,7 @@
 #include <zmk/events/ble_active_profile_changed.h>
 #include <zmk/events/usb_conn_state_changed.h>
 #include <zmk/events/endpoint_changed.h>
+#include <zmk/boot_profiler.h>
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
@@ -33,16 +36,13 @@ static enum zmk_transport preferred_transport =
 static void update_current_endpoint(void);
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-static void endpoints_save_preferred_work(struct k_work *work) {
-    settings_save_one("endpoints/preferred", &preferred_transport, sizeof(preferred_transport));
-}
-
-static struct k_work_delayable endpoints_save_work;
+ZMK_SETTINGS_ENTRY_DEFINE(preferred_transport_setting, "endpoints/preferred", &preferred_transport,
+                          sizeof(preferred_transport));
 #endif
 
 static int endpoints_save_preferred(void) {
 #if IS_ENABLED(CONFIG_SETTINGS)
-    return k_work_reschedule(&endpoints_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
+    return zmk_settings_mark_dirty(&preferred_transport_setting);
 #else
     return 0;
 #endif
@@ -188,6 +188,65 @@ static int send_consumer_report(void) {
     return -ENOTSUP;
 }
 
+#if IS_ENABLED(CONFIG_ZMK_ENDPOINTS_COALESCE_REPORTS)
+
+#define PENDING_KEYBOARD_REPORT BIT(0)
+#define PENDING_CONSUMER_REPORT BIT(1)
+
+static atomic_t pending_reports = ATOMIC_INIT(0);
+
+static void flush_reports_work_handler(struct k_work *work) { zmk_endpoints_flush_reports(); }
+
+// Events are processed from the system work queue, so this runs once the work item that
+// changed the reports is done.
+static K_WORK_DEFINE(flush_reports_work, flush_reports_work_handler);
+
+int zmk_endpoints_send_report(uint16_t usage_page) {
+
+    LOG_DBG("usage page 0x%02X", usage_page);
+    switch (usage_page) {
+    case HID_USAGE_KEY:
+        atomic_or(&pending_reports, PENDING_KEYBOARD_REPORT);
+        break;
+
+    case HID_USAGE_CONSUMER:
+        atomic_or(&pending_reports, PENDING_CONSUMER_REPORT);
+        break;
+
+    default:
+        LOG_ERR("Unsupported usage page %d", usage_page);
+        return -ENOTSUP;
+    }
+
+    k_work_submit(&flush_reports_work);
+    return 0;
+}
+
+int zmk_endpoints_flush_reports(void) {
+    atomic_val_t pending = atomic_clear(&pending_reports);
+    int ret = 0;
+
+    if (pending & PENDING_KEYBOARD_REPORT) {
+        LOG_DBG("sending coalesced keyboard report");
+        int err = send_keyboard_report();
+        if (err) {
+            ret = err;
+        }
+    }
+
+    if (pending & PENDING_CONSUMER_REPORT) {
+        LOG_DBG("sending coalesced consumer report");
+        int err = send_consumer_report();
+        if (err) {
+            ret = err;
+        }
+    }
+
+    return ret;
+}
+
+#else
+
 int zmk_endpoints_send_report(uint16_t usage_page) {
 
     LOG_DBG("usage page 0x%02X", usage_page);
@@ -203,6 +262,10 @@ int zmk_endpoints_send_report(uint16_t usage_page) {
     return -ENOTSUP;
 }
 
+int zmk_endpoints_flush_reports(void) { return 0; }
+
+#endif /* IS_ENABLED(CONFIG_ZMK_ENDPOINTS_COALESCE_REPORTS) */
+
 #if IS_ENABLED(CONFIG_ZMK_MOUSE)
 int zmk_endpoints_send_mouse_report() {
     switch (current_instance.transport) {
@@ -256,14 +319,12 @@ static int endpoints_handle_set(const char *name, size_t len, settings_read_cb r
             LOG_ERR("Failed to read preferred endpoint from settings (err %d)", err);
             return err;
         }
-
-        update_current_endpoint();
     }
 
     return 0;
 }
 
-struct settings_handler endpoints_handler = {.name = "endpoints", .h_set = endpoints_handle_set};
+ZMK_SETTINGS_HANDLER_DEFINE(endpoints, "endpoints", endpoints_handle_set);
 #endif /* IS_ENABLED(CONFIG_SETTINGS) */
 
 static bool is_usb_ready(void) {
@@ -321,20 +382,6 @@ static struct zmk_endpoint_instance get_selected_instance(void) {
 }
 
 static int zmk_endpoints_init(void) {
-#if IS_ENABLED(CONFIG_SETTINGS)
-    settings_subsys_init();
-
-    int err = settings_register(&endpoints_handler);
-    if (err) {
-        LOG_ERR("Failed to register the endpoints settings handler (err %d)", err);
-        return err;
-    }
-
-    k_work_init_delayable(&endpoints_save_work, endpoints_save_preferred_work);
-
-    settings_load_subtree("endpoints");
-#endif
-
     current_instance = get_selected_instance();
 
     return 0;
@@ -349,6 +396,8 @@ void zmk_endpoints_clear_current(void) {
 
     zmk_endpoints_send_report(HID_USAGE_KEY);
     zmk_endpoints_send_report(HID_USAGE_CONSUMER);
+    // the cleared reports have to reach the old endpoint before it changes.
+    zmk_endpoints_flush_reports();
 }
 
 static void update_current_endpoint(void) {
@@ -381,4 +430,4 @@ ZMK_SUBSCRIPTION(endpoint_listener, zmk_usb_conn_state_changed);
 ZMK_SUBSCRIPTION(endpoint_listener, zmk_ble_active_profile_changed);
 #endif
 
-SYS_INIT(zmk_endpoints_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+ZMK_SYS_INIT(zmk_endpoints_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
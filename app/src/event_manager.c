@@ -5,11 +5,13 @@
  */
 
 #include <zephyr/kernel.h>
+#include <zephyr/init.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/event_manager.h>
+#include <zmk/boot_profiler.h>
 
 extern struct zmk_event_type *__event_type_start[];
 extern struct zmk_event_type *__event_type_end[];
@@ -19,12 +21,10 @@ extern struct zmk_event_subscription __event_subscriptions_end[];
 
 int zmk_event_manager_handle_from(zmk_event_t *event, uint8_t start_index) {
     int ret = 0;
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = start_index; i < len; i++) {
+    const struct zmk_event_subscribers *subs = event->event->subscribers;
+    uint8_t end = subs->start + subs->len;
+    for (int i = MAX(start_index, subs->start); i < end; i++) {
         struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
-        if (ev_sub->event_type != event->event) {
-            continue;
-        }
         event->last_listener_index = i;
         ret = ev_sub->listener->callback(event);
         switch (ret) {
@@ -45,31 +45,44 @@ int zmk_event_manager_handle_from(zmk_event_t *event, uint8_t start_index) {
     return 0;
 }
 
-int zmk_event_manager_raise(zmk_event_t *event) { return zmk_event_manager_handle_from(event, 0); }
+static int find_listener_index(const zmk_event_t *event, const struct zmk_listener *listener) {
+    const struct zmk_event_subscribers *subs = event->event->subscribers;
+    uint8_t end = subs->start + subs->len;
 
-int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = 0; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
+    // Events re-raised by the listener that captured or is handling them already carry that
+    // listener's slot, so check it before falling back to a scan of this event type's subscribers.
+    uint8_t last = event->last_listener_index;
+    if (last >= subs->start && last < end &&
+        __event_subscriptions_start[last].listener == listener) {
+        return last;
+    }
 
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i + 1);
+    for (int i = subs->start; i < end; i++) {
+        if (__event_subscriptions_start[i].listener == listener) {
+            return i;
         }
     }
 
+    return -ENOENT;
+}
+
+int zmk_event_manager_raise(zmk_event_t *event) { return zmk_event_manager_handle_from(event, 0); }
+
+int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
+    int index = find_listener_index(event, listener);
+    if (index >= 0) {
+        return zmk_event_manager_handle_from(event, index + 1);
+    }
+
     LOG_WRN("Unable to find where to raise this after event");
 
     return -EINVAL;
 }
 
 int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *listener) {
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = 0; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
-
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i);
-        }
+    int index = find_listener_index(event, listener);
+    if (index >= 0) {
+        return zmk_event_manager_handle_from(event, index);
     }
 
     LOG_WRN("Unable to find where to raise this event");
@@ -80,3 +93,23 @@ int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *li
 int zmk_event_manager_release(zmk_event_t *event) {
     return zmk_event_manager_handle_from(event, event->last_listener_index + 1);
 }
+
+static int zmk_event_manager_init(void) {
+    // The linker groups subscriptions by event type (keeping link order within each type), so
+    // each type only needs to know where its run of subscribers starts and how long it is.
+    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
+    for (int i = 0; i < len; i++) {
+        struct zmk_event_subscribers *subs = __event_subscriptions_start[i].event_type->subscribers;
+        if (subs->len == 0) {
+            subs->start = i;
+        }
+
+        __ASSERT(subs->start + subs->len == i, "Subscriptions for %s are not contiguous",
+                 __event_subscriptions_start[i].event_type->name);
+        subs->len++;
+    }
+
+    return 0;
+}
+
+ZMK_SYS_INIT(zmk_event_manager_init, PRE_KERNEL_1, 0);
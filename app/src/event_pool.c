@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include <zmk/event_pool.h>
+
+extern struct zmk_event_pool_stats *__event_pool_start[];
+extern struct zmk_event_pool_stats *__event_pool_end[];
+
+static int cmd_event_pools(const struct shell *sh, size_t argc, char **argv) {
+    for (struct zmk_event_pool_stats **pool = __event_pool_start; pool < __event_pool_end;
+         pool++) {
+        const struct zmk_event_pool_stats *stats = *pool;
+        shell_print(sh, "%s: %u/%u used, %u peak, %u captured, %u shared, %u overflowed",
+                    stats->name, stats->used, stats->size, stats->peak, stats->captures,
+                    stats->shared, stats->overflows);
+    }
+
+    return 0;
+}
+
+SHELL_CMD_REGISTER(event_pools, NULL, "Show event pool usage", cmd_event_pools);
@@ -8,3 +8,7 @@
 #include <zmk/events/keycode_state_changed.h>
 
 ZMK_EVENT_IMPL(zmk_keycode_state_changed);
+
+#if CONFIG_ZMK_EVENT_POOL_KEYCODE_STATE_CHANGED_SIZE > 0
+ZMK_EVENT_POOL_IMPL(zmk_keycode_state_changed, CONFIG_ZMK_EVENT_POOL_KEYCODE_STATE_CHANGED_SIZE);
+#endif
@@ -7,4 +7,8 @@
 #include <zephyr/kernel.h>
 #include <zmk/events/position_state_changed.h>
 
-ZMK_EVENT_IMPL(zmk_position_state_changed);
\ No newline at end of file
+ZMK_EVENT_IMPL(zmk_position_state_changed);
+
+#if CONFIG_ZMK_EVENT_POOL_POSITION_STATE_CHANGED_SIZE > 0
+ZMK_EVENT_POOL_IMPL(zmk_position_state_changed, CONFIG_ZMK_EVENT_POOL_POSITION_STATE_CHANGED_SIZE);
+#endif
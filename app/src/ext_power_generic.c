@@ -15,6 +15,7 @@
 #include <zephyr/drivers/gpio.h>
 
 #include <drivers/ext_power.h>
+#include <zmk/settings.h>
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
@@ -34,22 +35,15 @@ struct ext_power_generic_data {
 };
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-static void ext_power_save_state_work(struct k_work *work) {
-    char setting_path[40];
-    const struct device *ext_power = DEVICE_DT_GET(DT_DRV_INST(0));
-    struct ext_power_generic_data *data = ext_power->data;
-
-    snprintf(setting_path, sizeof(setting_path), "ext_power/state/%s", ext_power->name);
-    settings_save_one(setting_path, &data->status, sizeof(data->status));
-}
+// "ext_power/state/<device name>" and the device's status are filled in at init.
+static char ext_power_setting_path[40];
 
-static struct k_work_delayable ext_power_save_work;
+ZMK_SETTINGS_ENTRY_DEFINE(ext_power_state_setting, ext_power_setting_path, NULL, sizeof(bool));
 #endif
 
 int ext_power_save_state(void) {
 #if IS_ENABLED(CONFIG_SETTINGS)
-    int ret = k_work_reschedule(&ext_power_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
-    return MIN(ret, 0);
+    return zmk_settings_mark_dirty(&ext_power_state_setting);
 #else
     return 0;
 #endif
@@ -86,6 +80,7 @@ static int ext_power_generic_get(const struct device *dev) {
 }
 
 #if IS_ENABLED(CONFIG_SETTINGS)
+// Settings are loaded before the device is initialized, which applies the status.
 static int ext_power_settings_set_status(const struct device *dev, size_t len,
                                          settings_read_cb read_cb, void *cb_arg) {
     struct ext_power_generic_data *data = dev->data;
@@ -97,13 +92,6 @@ static int ext_power_settings_set_status(const struct device *dev, size_t len,
     int rc = read_cb(cb_arg, &data->status, sizeof(data->status));
     if (rc >= 0) {
         data->settings_init = true;
-
-        if (data->status) {
-            ext_power_generic_enable(dev);
-        } else {
-            ext_power_generic_disable(dev);
-        }
-
         return 0;
     }
     return rc;
@@ -121,8 +109,10 @@ static int ext_power_settings_set(const char *name, size_t len, settings_read_cb
     return -ENOENT;
 }
 
-struct settings_handler ext_power_conf = {.name = "ext_power/state",
-                                          .h_set = ext_power_settings_set};
+ZMK_SETTINGS_HANDLER_DEFINE(ext_power, "ext_power/state", ext_power_settings_set);
+
+BUILD_ASSERT(CONFIG_ZMK_SETTINGS_LOAD_INIT_PRIORITY < 81,
+             "Settings must be loaded before external power control is initialized");
 #endif
 
 static int ext_power_generic_init(const struct device *dev) {
@@ -135,24 +125,20 @@ static int ext_power_generic_init(const struct device *dev) {
     }
 
 #if IS_ENABLED(CONFIG_SETTINGS)
-    settings_subsys_init();
-
-    int err = settings_register(&ext_power_conf);
-    if (err) {
-        LOG_ERR("Failed to register the ext_power settings handler (err %d)", err);
-        return err;
-    }
-
-    k_work_init_delayable(&ext_power_save_work, ext_power_save_state_work);
+    snprintf(ext_power_setting_path, sizeof(ext_power_setting_path), "ext_power/state/%s",
+             dev->name);
+    ext_power_state_setting.value = &data->status;
 
     // Set default value (on) if settings isn't set
-    settings_load_subtree("ext_power");
     if (!data->settings_init) {
-
         data->status = true;
-        k_work_schedule(&ext_power_save_work, K_NO_WAIT);
+        zmk_settings_mark_dirty(&ext_power_state_setting);
+    }
 
-        ext_power_enable(dev);
+    // The loaded status is already saved, so it is applied without saving it again.
+    if (gpio_pin_set_dt(&config->control, data->status)) {
+        LOG_WRN("Failed to set ext-power control pin");
+        return -EIO;
     }
 #else
     // Default to the ext_power being open when no settings
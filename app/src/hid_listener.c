@@ -15,10 +15,21 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/hid.h>
 #include <dt-bindings/zmk/hid_usage_pages.h>
 #include <zmk/endpoints.h>
+#include <zmk/latency_trace.h>
+
+// Set when a release is waiting in a coalesced report.
+static bool release_pending;
 
 static int hid_listener_keycode_pressed(const struct zmk_keycode_state_changed *ev) {
     int err, explicit_mods_changed, implicit_mods_changed;
 
+    // a release in the same burst has to reach the host before the next press, or a quick
+    // double tap of one key would be merged into a single press.
+    if (release_pending) {
+        release_pending = false;
+        zmk_endpoints_flush_reports();
+    }
+
     if (!is_mod(ev->usage_page, ev->keycode) &&
         zmk_hid_is_pressed(ZMK_HID_USAGE(ev->usage_page, ev->keycode))) {
         LOG_DBG("unregistering usage_page 0x%02X keycode 0x%02X since it was already pressed",
@@ -32,6 +43,8 @@ static int hid_listener_keycode_pressed(const struct zmk_keycode_state_changed *
         if (err < 0) {
             LOG_ERR("Failed to send key report for pre-releasing keycode (%d)", err);
         }
+        // the host has to see the release before the key is pressed again.
+        zmk_endpoints_flush_reports();
     }
 
     LOG_DBG("usage_page 0x%02X keycode 0x%02X implicit_mods 0x%02X explicit_mods 0x%02X",
@@ -58,6 +71,9 @@ static int hid_listener_keycode_pressed(const struct zmk_keycode_state_changed *
 static int hid_listener_keycode_released(const struct zmk_keycode_state_changed *ev) {
     int err, explicit_mods_changed, implicit_mods_changed;
 
+    // a key pressed in the same burst has to reach the host before it is released.
+    zmk_endpoints_flush_reports();
+
     LOG_DBG("usage_page 0x%02X keycode 0x%02X implicit_mods 0x%02X explicit_mods 0x%02X",
             ev->usage_page, ev->keycode, ev->implicit_modifiers, ev->explicit_modifiers);
     err = zmk_hid_release(ZMK_HID_USAGE(ev->usage_page, ev->keycode));
@@ -82,12 +98,15 @@ static int hid_listener_keycode_released(const struct zmk_keycode_state_changed
                     err);
         }
     }
+
+    release_pending = true;
     return zmk_endpoints_send_report(ev->usage_page);
 }
 
 int hid_listener(const zmk_event_t *eh) {
     const struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
     if (ev) {
+        zmk_latency_trace_mark_current(ZMK_LATENCY_TRACE_STAGE_HID);
         if (ev->state) {
             hid_listener_keycode_pressed(ev);
         } else {
@@ -4,20 +4,29 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <string.h>
+
 #include <zephyr/settings/settings.h>
 #include <zephyr/init.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
 
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/gatt.h>
 
 #include <zmk/ble.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/ble_active_profile_changed.h>
 #include <zmk/endpoints_types.h>
 #include <zmk/hog.h>
 #include <zmk/hid.h>
+#include <zmk/latency_trace.h>
+#include <zmk/boot_profiler.h>
 #if IS_ENABLED(CONFIG_ZMK_HID_INDICATORS)
 #include <zmk/hid_indicators.h>
 #endif // IS_ENABLED(CONFIG_ZMK_HID_INDICATORS)
@@ -239,164 +248,332 @@ K_THREAD_STACK_DEFINE(hog_q_stack, CONFIG_ZMK_BLE_THREAD_STACK_SIZE);
 
 struct k_work_q hog_work_q;
 
-K_MSGQ_DEFINE(zmk_hog_keyboard_msgq, sizeof(struct zmk_hid_keyboard_report_body),
-              CONFIG_ZMK_BLE_KEYBOARD_REPORT_QUEUE_SIZE, 4);
+#if defined(CONFIG_BT_CONN_TX_MAX)
+#define HOG_MAX_IN_FLIGHT MIN(CONFIG_ZMK_BLE_MAX_IN_FLIGHT_REPORTS, CONFIG_BT_CONN_TX_MAX)
+#else
+#define HOG_MAX_IN_FLIGHT CONFIG_ZMK_BLE_MAX_IN_FLIGHT_REPORTS
+#endif
 
-void send_keyboard_report_callback(struct k_work *work) {
-    struct zmk_hid_keyboard_report_body report;
+// retry delay when the stack has no buffers left and nothing is in flight to wake us up
+#define HOG_RETRY_MS 5
 
-    while (k_msgq_get(&zmk_hog_keyboard_msgq, &report, K_NO_WAIT) == 0) {
-        struct bt_conn *conn = destination_connection();
-        if (conn == NULL) {
-            return;
-        }
+union hog_report {
+    struct zmk_hid_keyboard_report_body keyboard;
+    struct zmk_hid_consumer_report_body consumer;
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+    struct zmk_hid_mouse_report_body mouse;
+#endif // IS_ENABLED(CONFIG_ZMK_MOUSE)
+};
 
-        struct bt_gatt_notify_params notify_params = {
-            .attr = &hog_svc.attrs[5],
-            .data = &report,
-            .len = sizeof(report),
-        };
-
-        int err = bt_gatt_notify_cb(conn, &notify_params);
-        if (err == -EPERM) {
-            bt_conn_set_security(conn, BT_SECURITY_L2);
-        } else if (err) {
-            LOG_DBG("Error notifying %d", err);
-        }
+// Reports waiting to be notified on one report characteristic. When the queue is full, a
+// mergeable report replaces the newest unsent one if the host would not miss a press or release
+// by skipping it. Otherwise it is kept as the latest state, which is queued as soon as a queued
+// report has been sent. Queuing never waits, so the caller is never blocked by a slow host.
+struct hog_report_queue {
+    const struct bt_gatt_attr *attr;
+    uint8_t *reports;
+    // the newest report that did not fit in the queue, valid if has_latest is set
+    uint8_t *latest;
+    uint8_t report_size;
+    // leading bytes that hold one bit per key or modifier, the rest are arrays of usages
+    uint8_t bitmap_len;
+    // whether reports are snapshots of the full HID state, so equal reports can be skipped
+    bool mergeable;
+    bool has_latest;
+    uint8_t capacity;
+    uint8_t head;
+    uint8_t count;
+};
 
-        bt_conn_unref(conn);
+#define HOG_REPORT_QUEUE_DEFINE(name, body_type, bitmap_size, is_mergeable, queue_size,            \
+                                attr_index)                                                        \
+    static uint8_t name##_reports[queue_size][sizeof(body_type)];                                  \
+    static uint8_t name##_latest[sizeof(body_type)];                                               \
+    static struct hog_report_queue name = {                                                        \
+        .attr = &hog_svc.attrs[attr_index],                                                        \
+        .reports = &name##_reports[0][0],                                                          \
+        .latest = name##_latest,                                                                   \
+        .report_size = sizeof(body_type),                                                          \
+        .bitmap_len = bitmap_size,                                                                 \
+        .mergeable = is_mergeable,                                                                 \
+        .capacity = queue_size,                                                                    \
     }
+
+// NKRO keys are a bitmap like the modifiers, HKRO keys are an array of usages.
+HOG_REPORT_QUEUE_DEFINE(keyboard_queue, struct zmk_hid_keyboard_report_body,
+                        IS_ENABLED(CONFIG_ZMK_HID_REPORT_TYPE_NKRO)
+                            ? sizeof(struct zmk_hid_keyboard_report_body)
+                            : sizeof(zmk_mod_flags_t),
+                        true, CONFIG_ZMK_BLE_KEYBOARD_REPORT_QUEUE_SIZE, 5);
+HOG_REPORT_QUEUE_DEFINE(consumer_queue, struct zmk_hid_consumer_report_body, 0, true,
+                        CONFIG_ZMK_BLE_CONSUMER_REPORT_QUEUE_SIZE, 9);
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+// Mouse reports carry relative movement, so two equal reports are two moves and none of them
+// can be skipped or merged.
+HOG_REPORT_QUEUE_DEFINE(mouse_queue, struct zmk_hid_mouse_report_body, 0, false,
+                        CONFIG_ZMK_BLE_MOUSE_REPORT_QUEUE_SIZE, 13);
+#endif // IS_ENABLED(CONFIG_ZMK_MOUSE)
+
+// in the order they are drained, so key presses are not held back by mouse movement
+static struct hog_report_queue *const report_queues[] = {
+    &keyboard_queue,
+    &consumer_queue,
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+    &mouse_queue,
+#endif // IS_ENABLED(CONFIG_ZMK_MOUSE)
+};
+
+static struct k_spinlock queue_lock;
+
+static void submit_send_work(void);
+
+static inline uint8_t *queued_report(struct hog_report_queue *queue, uint8_t index) {
+    return &queue->reports[((queue->head + index) % queue->capacity) * queue->report_size];
 }
 
-K_WORK_DEFINE(hog_keyboard_work, send_keyboard_report_callback);
+// Whether the host can go from the report before the newest queued one straight to the new
+// report without missing a press or release that only the newest queued one has.
+static bool can_replace_newest(struct hog_report_queue *queue, const uint8_t *report) {
+    if (queue->count < 2) {
+        return false;
+    }
 
-int zmk_hog_send_keyboard_report(struct zmk_hid_keyboard_report_body *report) {
-    int err = k_msgq_put(&zmk_hog_keyboard_msgq, report, K_MSEC(100));
-    if (err) {
-        switch (err) {
-        case -EAGAIN: {
-            LOG_WRN("Keyboard message queue full, popping first message and queueing again");
-            struct zmk_hid_keyboard_report_body discarded_report;
-            k_msgq_get(&zmk_hog_keyboard_msgq, &discarded_report, K_NO_WAIT);
-            return zmk_hog_send_keyboard_report(report);
-        }
-        default:
-            LOG_WRN("Failed to queue keyboard report to send (%d)", err);
-            return err;
+    const uint8_t *before = queued_report(queue, queue->count - 2);
+    const uint8_t *newest = queued_report(queue, queue->count - 1);
+
+    // a bit the newest report flips and the new report flips back would never reach the host
+    for (int i = 0; i < queue->bitmap_len; i++) {
+        if ((before[i] ^ newest[i]) & (newest[i] ^ report[i])) {
+            return false;
         }
     }
 
-    k_work_submit_to_queue(&hog_work_q, &hog_keyboard_work);
+    // usage arrays can't be merged, so they must not change in one of the two steps
+    size_t len = queue->report_size - queue->bitmap_len;
+    return memcmp(newest + queue->bitmap_len, before + queue->bitmap_len, len) == 0 ||
+           memcmp(newest + queue->bitmap_len, report + queue->bitmap_len, len) == 0;
+}
 
-    return 0;
-};
+// Adds a report to the queue, merging it with the newest queued report if that loses nothing.
+// Must be called with queue_lock held.
+static bool try_queue_report(struct hog_report_queue *queue, const void *report) {
+    if (queue->mergeable && queue->count > 0 &&
+        memcmp(queued_report(queue, queue->count - 1), report, queue->report_size) == 0) {
+        // the same state is already waiting to be sent
+        return true;
+    }
 
-K_MSGQ_DEFINE(zmk_hog_consumer_msgq, sizeof(struct zmk_hid_consumer_report_body),
-              CONFIG_ZMK_BLE_CONSUMER_REPORT_QUEUE_SIZE, 4);
+    if (queue->count < queue->capacity) {
+        memcpy(queued_report(queue, queue->count), report, queue->report_size);
+        queue->count++;
+        return true;
+    }
 
-void send_consumer_report_callback(struct k_work *work) {
-    struct zmk_hid_consumer_report_body report;
+    if (queue->mergeable && can_replace_newest(queue, report)) {
+        memcpy(queued_report(queue, queue->count - 1), report, queue->report_size);
+        return true;
+    }
 
-    while (k_msgq_get(&zmk_hog_consumer_msgq, &report, K_NO_WAIT) == 0) {
-        struct bt_conn *conn = destination_connection();
-        if (conn == NULL) {
-            return;
-        }
+    return false;
+}
 
-        struct bt_gatt_notify_params notify_params = {
-            .attr = &hog_svc.attrs[9],
-            .data = &report,
-            .len = sizeof(report),
-        };
-
-        int err = bt_gatt_notify_cb(conn, &notify_params);
-        if (err == -EPERM) {
-            bt_conn_set_security(conn, BT_SECURITY_L2);
-        } else if (err) {
-            LOG_DBG("Error notifying %d", err);
+static void queue_report(struct hog_report_queue *queue, const void *report) {
+    k_spinlock_key_t key = k_spin_lock(&queue_lock);
+
+    // a newer report must not overtake the latest state that is still waiting for room
+    if (queue->has_latest || !try_queue_report(queue, report)) {
+        if (!queue->has_latest) {
+            LOG_WRN("Report queue full, sending the latest state once there is room");
         }
+        memcpy(queue->latest, report, queue->report_size);
+        queue->has_latest = true;
+    }
+
+    k_spin_unlock(&queue_lock, key);
+}
+
+// Copies the oldest queued report. It stays queued until it has been sent, so a full queue never
+// has to drop it.
+static bool peek_report(struct hog_report_queue *queue, void *report) {
+    k_spinlock_key_t key = k_spin_lock(&queue_lock);
 
-        bt_conn_unref(conn);
+    bool found = queue->count > 0;
+    if (found) {
+        memcpy(report, queued_report(queue, 0), queue->report_size);
     }
-};
 
-K_WORK_DEFINE(hog_consumer_work, send_consumer_report_callback);
+    k_spin_unlock(&queue_lock, key);
+    return found;
+}
 
-int zmk_hog_send_consumer_report(struct zmk_hid_consumer_report_body *report) {
-    int err = k_msgq_put(&zmk_hog_consumer_msgq, report, K_MSEC(100));
-    if (err) {
-        switch (err) {
-        case -EAGAIN: {
-            LOG_WRN("Consumer message queue full, popping first message and queueing again");
-            struct zmk_hid_consumer_report_body discarded_report;
-            k_msgq_get(&zmk_hog_consumer_msgq, &discarded_report, K_NO_WAIT);
-            return zmk_hog_send_consumer_report(report);
-        }
-        default:
-            LOG_WRN("Failed to queue consumer report to send (%d)", err);
-            return err;
-        }
+// Removes the oldest queued report once it has been sent, and queues the latest state in the
+// room it leaves.
+static void pop_report(struct hog_report_queue *queue) {
+    k_spinlock_key_t key = k_spin_lock(&queue_lock);
+
+    if (queue->count > 0) {
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
     }
 
-    k_work_submit_to_queue(&hog_work_q, &hog_consumer_work);
+    if (queue->has_latest && try_queue_report(queue, queue->latest)) {
+        queue->has_latest = false;
+    }
 
-    return 0;
-};
+    k_spin_unlock(&queue_lock, key);
+}
 
-#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+static void clear_queues(void) {
+    k_spinlock_key_t key = k_spin_lock(&queue_lock);
 
-K_MSGQ_DEFINE(zmk_hog_mouse_msgq, sizeof(struct zmk_hid_mouse_report_body),
-              CONFIG_ZMK_BLE_MOUSE_REPORT_QUEUE_SIZE, 4);
+    for (int i = 0; i < ARRAY_SIZE(report_queues); i++) {
+        report_queues[i]->count = 0;
+        report_queues[i]->has_latest = false;
+    }
 
-void send_mouse_report_callback(struct k_work *work) {
-    struct zmk_hid_mouse_report_body report;
-    while (k_msgq_get(&zmk_hog_mouse_msgq, &report, K_NO_WAIT) == 0) {
-        struct bt_conn *conn = destination_connection();
-        if (conn == NULL) {
-            return;
-        }
+    k_spin_unlock(&queue_lock, key);
+}
 
-        struct bt_gatt_notify_params notify_params = {
-            .attr = &hog_svc.attrs[13],
-            .data = &report,
-            .len = sizeof(report),
-        };
-
-        int err = bt_gatt_notify_cb(conn, &notify_params);
-        if (err == -EPERM) {
-            bt_conn_set_security(conn, BT_SECURITY_L2);
-        } else if (err) {
-            LOG_DBG("Error notifying %d", err);
-        }
+// The connection reports are sent to. Only used from hog_work_q, other threads mark it as
+// stale and let the work item drop it.
+static struct bt_conn *active_conn;
+static atomic_t active_conn_stale = ATOMIC_INIT(0);
+
+// Notifications handed to the stack that have not completed yet.
+static atomic_t in_flight = ATOMIC_INIT(0);
+// How many notifications may be in flight at once. It shrinks to what the stack could take
+// when it runs out of ACL buffers, and grows back with every notification it accepts. Only
+// used from hog_work_q.
+static int in_flight_window = HOG_MAX_IN_FLIGHT;
+
+static void send_reports_callback(struct k_work *work);
 
-        bt_conn_unref(conn);
+K_WORK_DELAYABLE_DEFINE(hog_send_work, send_reports_callback);
+
+static void submit_send_work(void) {
+    k_work_reschedule_for_queue(&hog_work_q, &hog_send_work, K_NO_WAIT);
+}
+
+static void notify_complete(struct bt_conn *conn, void *user_data) {
+    // completions of a connection that was dropped in the meantime must not go negative
+    if (atomic_dec(&in_flight) <= 0) {
+        atomic_set(&in_flight, 0);
     }
-};
 
-K_WORK_DEFINE(hog_mouse_work, send_mouse_report_callback);
+    submit_send_work();
+}
+
+static struct bt_conn *hog_connection(void) {
+    if (atomic_cas(&active_conn_stale, 1, 0) && active_conn != NULL) {
+        bt_conn_unref(active_conn);
+        active_conn = NULL;
+    }
 
-int zmk_hog_send_mouse_report(struct zmk_hid_mouse_report_body *report) {
-    int err = k_msgq_put(&zmk_hog_mouse_msgq, report, K_MSEC(100));
-    if (err) {
-        switch (err) {
-        case -EAGAIN: {
-            LOG_WRN("Consumer message queue full, popping first message and queueing again");
-            struct zmk_hid_mouse_report_body discarded_report;
-            k_msgq_get(&zmk_hog_mouse_msgq, &discarded_report, K_NO_WAIT);
-            return zmk_hog_send_mouse_report(report);
-        }
-        default:
-            LOG_WRN("Failed to queue mouse report to send (%d)", err);
-            return err;
+    if (active_conn == NULL) {
+        active_conn = destination_connection();
+        atomic_set(&in_flight, 0);
+        in_flight_window = HOG_MAX_IN_FLIGHT;
+    }
+
+    return active_conn;
+}
+
+static void send_reports_callback(struct k_work *work) {
+    struct bt_conn *conn = hog_connection();
+    if (conn == NULL) {
+        clear_queues();
+        return;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(report_queues); i++) {
+        struct hog_report_queue *queue = report_queues[i];
+        union hog_report report;
+
+        while (atomic_get(&in_flight) < in_flight_window && peek_report(queue, &report)) {
+            struct bt_gatt_notify_params notify_params = {
+                .attr = queue->attr,
+                .data = &report,
+                .len = queue->report_size,
+                .func = notify_complete,
+            };
+
+            atomic_inc(&in_flight);
+            int err = bt_gatt_notify_cb(conn, &notify_params);
+            if (err == 0) {
+                pop_report(queue);
+                in_flight_window = MIN(in_flight_window + 1, HOG_MAX_IN_FLIGHT);
+                continue;
+            }
+
+            atomic_dec(&in_flight);
+
+            if (err == -ENOMEM || err == -ENOBUFS) {
+                // the report stays queued for the retry
+                int pending = (int)atomic_get(&in_flight);
+                in_flight_window = MAX(pending, 1);
+                LOG_DBG("Out of buffers, limiting in-flight reports to %d", in_flight_window);
+
+                if (pending == 0) {
+                    k_work_schedule_for_queue(&hog_work_q, &hog_send_work, K_MSEC(HOG_RETRY_MS));
+                }
+                return;
+            }
+
+            pop_report(queue);
+            if (err == -EPERM) {
+                bt_conn_set_security(conn, BT_SECURITY_L2);
+            } else {
+                LOG_DBG("Error notifying %d", err);
+            }
         }
     }
+}
 
-    k_work_submit_to_queue(&hog_work_q, &hog_mouse_work);
+int zmk_hog_send_keyboard_report(struct zmk_hid_keyboard_report_body *report) {
+    queue_report(&keyboard_queue, report);
+    submit_send_work();
+    zmk_latency_trace_mark_current(ZMK_LATENCY_TRACE_STAGE_REPORT);
+
+    return 0;
+};
+
+int zmk_hog_send_consumer_report(struct zmk_hid_consumer_report_body *report) {
+    queue_report(&consumer_queue, report);
+    submit_send_work();
+
+    return 0;
+};
+
+#if IS_ENABLED(CONFIG_ZMK_MOUSE)
+
+int zmk_hog_send_mouse_report(struct zmk_hid_mouse_report_body *report) {
+    queue_report(&mouse_queue, report);
+    submit_send_work();
 
     return 0;
 };
+
 #endif // IS_ENABLED(CONFIG_ZMK_MOUSE)
 
+static void mark_connection_stale(void) {
+    atomic_set(&active_conn_stale, 1);
+    submit_send_work();
+}
+
+static void hog_disconnected(struct bt_conn *conn, uint8_t reason) { mark_connection_stale(); }
+
+BT_CONN_CB_DEFINE(hog_conn_callbacks) = {
+    .disconnected = hog_disconnected,
+};
+
+static int hog_listener(const zmk_event_t *eh) {
+    mark_connection_stale();
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(hog, hog_listener);
+ZMK_SUBSCRIPTION(hog, zmk_ble_active_profile_changed);
+
 static int zmk_hog_init(void) {
     static const struct k_work_queue_config queue_config = {.name = "HID Over GATT Send Work"};
     k_work_queue_start(&hog_work_q, hog_q_stack, K_THREAD_STACK_SIZEOF(hog_q_stack),
@@ -405,4 +582,4 @@ static int zmk_hog_init(void) {
     return 0;
 }
 
-SYS_INIT(zmk_hog_init, APPLICATION, CONFIG_ZMK_BLE_INIT_PRIORITY);
+ZMK_SYS_INIT(zmk_hog_init, APPLICATION, CONFIG_ZMK_BLE_INIT_PRIORITY);
@@ -5,9 +5,25 @@
  */
 
 #include <drivers/behavior.h>
+#include <zephyr/init.h>
 #include <zephyr/sys/util.h>
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/logging/log.h>
+#include <string.h>
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE)
+#include <stdio.h>
+#include <stdlib.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+
+#include <zmk/settings.h>
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE_SHELL)
+#include <zephyr/shell/shell.h>
+#endif
+
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/behavior.h>
@@ -15,6 +31,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/matrix.h>
 #include <zmk/sensors.h>
 #include <zmk/virtual_key_position.h>
+#include <zmk/latency_trace.h>
 
 #include <zmk/ble.h>
 #if ZMK_BLE_IS_CENTRAL
@@ -25,6 +42,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/events/position_state_changed.h>
 #include <zmk/events/layer_state_changed.h>
 #include <zmk/events/sensor_event.h>
+#include <zmk/boot_profiler.h>
 
 static zmk_keymap_layers_state_t _zmk_keymap_layer_state = 0;
 static uint8_t _zmk_keymap_layer_default = 0;
@@ -73,6 +91,44 @@ static struct zmk_behavior_binding zmk_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_
 static const char *zmk_keymap_layer_names[ZMK_KEYMAP_LAYERS_LEN] = {
     DT_INST_FOREACH_CHILD_SEP(0, LAYER_NAME, (, ))};
 
+// For each layer and position, the highest layer at or below it whose binding for that position
+// is not transparent, or -1 if there is none. Built once at init, so runs of &trans bindings can
+// be skipped without invoking them.
+static int8_t zmk_keymap_opaque_layer[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN];
+
+#define EFFECTIVE_LAYER_UNKNOWN INT8_MIN
+
+// For each position, the first layer to invoke for the current layer state. Reset whenever the
+// layer state changes and filled in again the next time the position is used.
+static int8_t zmk_keymap_effective_layer[ZMK_KEYMAP_LEN];
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE)
+
+// The bindings from devicetree, to tell which bindings have been changed and to reset them.
+static const struct zmk_behavior_binding
+    zmk_keymap_default[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN] = {
+        DT_INST_FOREACH_CHILD_SEP(0, TRANSFORMED_LAYER, (, ))};
+
+#define KEYMAP_ENTRY(layer, position) ((layer) * ZMK_KEYMAP_LEN + (position))
+
+// Bindings changed since they were last saved, and bindings that have an entry in settings.
+static ATOMIC_DEFINE(zmk_keymap_changed, ZMK_KEYMAP_LAYERS_LEN * ZMK_KEYMAP_LEN);
+static ATOMIC_DEFINE(zmk_keymap_stored, ZMK_KEYMAP_LAYERS_LEN * ZMK_KEYMAP_LEN);
+
+#define BEHAVIOR_NAME_MAX_LEN 32
+
+// Saved as "keymap/<layer>/<position>". Only as much of the behavior name as it needs is saved,
+// without a terminator.
+struct zmk_keymap_stored_binding {
+    uint32_t param1;
+    uint32_t param2;
+    char behavior_dev[BEHAVIOR_NAME_MAX_LEN];
+} __packed;
+
+#define STORED_BINDING_NAME_OFFSET offsetof(struct zmk_keymap_stored_binding, behavior_dev)
+
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE) */
+
 #if ZMK_KEYMAP_HAS_SENSORS
 
 static struct zmk_behavior_binding
@@ -96,6 +152,8 @@ static inline int set_layer_state(uint8_t layer, bool state) {
     WRITE_BIT(_zmk_keymap_layer_state, layer, state);
     // Don't send state changes unless there was an actual change
     if (old_state != _zmk_keymap_layer_state) {
+        memset(zmk_keymap_effective_layer, EFFECTIVE_LAYER_UNKNOWN,
+               sizeof(zmk_keymap_effective_layer));
         LOG_DBG("layer_changed: layer %d state %d", layer, state);
         ret = raise_layer_state_changed(layer, state);
         if (ret < 0) {
@@ -186,7 +244,7 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
 
     LOG_DBG("layer: %d position: %d, binding name: %s", layer, position, binding.behavior_dev);
 
-    behavior = zmk_behavior_get_binding(binding.behavior_dev);
+    behavior = zmk_behavior_binding_get_device(&binding);
 
     if (!behavior) {
         LOG_WRN("No behavior assigned to %d on layer %d", position, layer);
@@ -231,23 +289,57 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
     return -ENOTSUP;
 }
 
+// Find the highest layer at or below @p layer which is active in @p state and has a binding for
+// @p position that is not transparent. Returns -1 if there is no such layer.
+static int next_opaque_layer(uint32_t position, int layer, zmk_keymap_layers_state_t state) {
+    while (layer >= _zmk_keymap_layer_default) {
+        if (!zmk_keymap_layer_active_with_state(layer, state)) {
+            layer--;
+            continue;
+        }
+
+        int opaque_layer = zmk_keymap_opaque_layer[layer][position];
+        if (opaque_layer == layer) {
+            return layer;
+        }
+
+        layer = opaque_layer;
+    }
+
+    return -1;
+}
+
+static int first_layer_for_position(uint32_t position, zmk_keymap_layers_state_t state) {
+    if (state != _zmk_keymap_layer_state) {
+        return next_opaque_layer(position, ZMK_KEYMAP_LAYERS_LEN - 1, state);
+    }
+
+    if (zmk_keymap_effective_layer[position] == EFFECTIVE_LAYER_UNKNOWN) {
+        zmk_keymap_effective_layer[position] =
+            next_opaque_layer(position, ZMK_KEYMAP_LAYERS_LEN - 1, state);
+    }
+
+    return zmk_keymap_effective_layer[position];
+}
+
 int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pressed,
                                       int64_t timestamp) {
     if (pressed) {
         zmk_keymap_active_behavior_layer[position] = _zmk_keymap_layer_state;
     }
-    for (int layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer >= _zmk_keymap_layer_default; layer--) {
-        if (zmk_keymap_layer_active_with_state(layer, zmk_keymap_active_behavior_layer[position])) {
-            int ret = zmk_keymap_apply_position_state(source, layer, position, pressed, timestamp);
-            if (ret > 0) {
-                LOG_DBG("behavior processing to continue to next layer");
-                continue;
-            } else if (ret < 0) {
-                LOG_DBG("Behavior returned error: %d", ret);
-                return ret;
-            } else {
-                return ret;
-            }
+
+    zmk_keymap_layers_state_t state = zmk_keymap_active_behavior_layer[position];
+    for (int layer = first_layer_for_position(position, state); layer >= 0;
+         layer = next_opaque_layer(position, layer - 1, state)) {
+        int ret = zmk_keymap_apply_position_state(source, layer, position, pressed, timestamp);
+        if (ret > 0) {
+            LOG_DBG("behavior processing to continue to next layer");
+            continue;
+        } else if (ret < 0) {
+            LOG_DBG("Behavior returned error: %d", ret);
+            return ret;
+        } else {
+            return ret;
         }
     }
 
@@ -266,7 +358,7 @@ int zmk_keymap_sensor_event(uint8_t sensor_index,
         LOG_DBG("layer: %d sensor_index: %d, binding name: %s", layer, sensor_index,
                 binding->behavior_dev);
 
-        const struct device *behavior = zmk_behavior_get_binding(binding->behavior_dev);
+        const struct device *behavior = zmk_behavior_binding_get_device(binding);
         if (!behavior) {
             LOG_DBG("No behavior assigned to %d on layer %d", sensor_index, layer);
             continue;
@@ -314,6 +406,10 @@ int zmk_keymap_sensor_event(uint8_t sensor_index,
 int keymap_listener(const zmk_event_t *eh) {
     const struct zmk_position_state_changed *pos_ev;
     if ((pos_ev = as_zmk_position_state_changed(eh)) != NULL) {
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE)
+        zmk_latency_trace_set_current(pos_ev->trace_id);
+        zmk_latency_trace_mark(pos_ev->trace_id, ZMK_LATENCY_TRACE_STAGE_KEYMAP);
+#endif
         return zmk_keymap_position_state_changed(pos_ev->source, pos_ev->position, pos_ev->state,
                                                  pos_ev->timestamp);
     }
@@ -329,9 +425,326 @@ int keymap_listener(const zmk_event_t *eh) {
     return -ENOTSUP;
 }
 
+static const struct device *transparent_behavior(void) {
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_behavior_transparent)
+    return zmk_behavior_get_binding(DEVICE_DT_NAME(DT_INST(0, zmk_behavior_transparent)));
+#else
+    return NULL;
+#endif
+}
+
+static void update_opaque_layers(uint32_t position, const struct device *transparent) {
+    for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+        if (transparent != NULL && zmk_keymap[layer][position].resolved_dev == transparent) {
+            zmk_keymap_opaque_layer[layer][position] =
+                layer > 0 ? zmk_keymap_opaque_layer[layer - 1][position] : -1;
+        } else {
+            zmk_keymap_opaque_layer[layer][position] = layer;
+        }
+    }
+}
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE)
+
+// Changed bindings point at the name of their device, which lives as long as the firmware.
+static int set_binding(uint8_t layer, uint32_t position, const char *behavior_dev, uint32_t param1,
+                       uint32_t param2) {
+    const struct device *behavior = zmk_behavior_get_binding(behavior_dev);
+    if (behavior == NULL) {
+        return -ENODEV;
+    }
+
+    if (strlen(behavior->name) > BEHAVIOR_NAME_MAX_LEN) {
+        return -ENAMETOOLONG;
+    }
+
+    zmk_keymap[layer][position] = (struct zmk_behavior_binding){
+        .behavior_dev = (char *)behavior->name,
+        .param1 = param1,
+        .param2 = param2,
+        .resolved_dev = behavior,
+    };
+
+    return 0;
+}
+
+static bool is_default_binding(const struct zmk_behavior_binding *binding, uint8_t layer,
+                               uint32_t position) {
+    const struct zmk_behavior_binding *default_binding = &zmk_keymap_default[layer][position];
+
+    return binding->param1 == default_binding->param1 &&
+           binding->param2 == default_binding->param2 &&
+           strcmp(binding->behavior_dev, default_binding->behavior_dev) == 0;
+}
+
+static int save_binding(uint8_t layer, uint32_t position) {
+    int entry = KEYMAP_ENTRY(layer, position);
+    char setting_name[24];
+    int err;
+
+    // Bindings are changed from higher priority threads. A change made after the copy marks the
+    // binding again, so it is saved by the next flush.
+    k_sched_lock();
+    struct zmk_behavior_binding binding = zmk_keymap[layer][position];
+    k_sched_unlock();
+
+    snprintf(setting_name, sizeof(setting_name), "keymap/%d/%d", layer, position);
+
+    if (is_default_binding(&binding, layer, position)) {
+        // Bindings changed back before they were saved need no write at all.
+        if (!atomic_test_and_clear_bit(zmk_keymap_stored, entry)) {
+            return 0;
+        }
+
+        err = settings_delete(setting_name);
+        if (err < 0) {
+            atomic_set_bit(zmk_keymap_stored, entry);
+        }
+        return err;
+    }
+
+    struct zmk_keymap_stored_binding stored = {
+        .param1 = binding.param1,
+        .param2 = binding.param2,
+    };
+    size_t name_len = strlen(binding.behavior_dev);
+    memcpy(stored.behavior_dev, binding.behavior_dev, name_len);
+
+    err = settings_save_one(setting_name, &stored, STORED_BINDING_NAME_OFFSET + name_len);
+    if (err == 0) {
+        atomic_set_bit(zmk_keymap_stored, entry);
+    }
+    return err;
+}
+
+// Called by the settings writer from the low priority work queue.
+static int save_changed_bindings(void) {
+    int ret = 0;
+
+    for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+        for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+            int entry = KEYMAP_ENTRY(layer, position);
+            if (!atomic_test_and_clear_bit(zmk_keymap_changed, entry)) {
+                continue;
+            }
+
+            int err = save_binding(layer, position);
+            if (err < 0) {
+                LOG_ERR("Failed to save binding for %d on layer %d (err %d)", position, layer,
+                        err);
+                atomic_set_bit(zmk_keymap_changed, entry);
+                ret = err;
+            }
+        }
+    }
+
+    return ret;
+}
+
+ZMK_SETTINGS_ENTRY_DEFINE_SAVE(keymap_setting, "keymap", save_changed_bindings);
+
+static int keymap_binding_changed(uint8_t layer, uint32_t position) {
+    update_opaque_layers(position, transparent_behavior());
+    zmk_keymap_effective_layer[position] = EFFECTIVE_LAYER_UNKNOWN;
+
+    // Edits made in quick succession are written together once they stop.
+    atomic_set_bit(zmk_keymap_changed, KEYMAP_ENTRY(layer, position));
+    return zmk_settings_mark_dirty(&keymap_setting);
+}
+
+const struct zmk_behavior_binding *zmk_keymap_get_binding(uint8_t layer, uint32_t position) {
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN || position >= ZMK_KEYMAP_LEN) {
+        return NULL;
+    }
+
+    return &zmk_keymap[layer][position];
+}
+
+int zmk_keymap_set_binding(uint8_t layer, uint32_t position,
+                           const struct zmk_behavior_binding *binding) {
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN || position >= ZMK_KEYMAP_LEN) {
+        return -EINVAL;
+    }
+
+    int err = set_binding(layer, position, binding->behavior_dev, binding->param1, binding->param2);
+    if (err < 0) {
+        return err;
+    }
+
+    return keymap_binding_changed(layer, position);
+}
+
+int zmk_keymap_reset_binding(uint8_t layer, uint32_t position) {
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN || position >= ZMK_KEYMAP_LEN) {
+        return -EINVAL;
+    }
+
+    zmk_keymap[layer][position] = zmk_keymap_default[layer][position];
+    zmk_behavior_binding_resolve(&zmk_keymap[layer][position]);
+
+    return keymap_binding_changed(layer, position);
+}
+
+static int keymap_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                               void *cb_arg) {
+    char *endptr;
+    uint32_t layer = strtoul(name, &endptr, 10);
+    if (*endptr != '/') {
+        LOG_WRN("Invalid keymap setting: %s", name);
+        return -EINVAL;
+    }
+
+    uint32_t position = strtoul(endptr + 1, &endptr, 10);
+    if (*endptr != '\0' || layer >= ZMK_KEYMAP_LAYERS_LEN || position >= ZMK_KEYMAP_LEN) {
+        LOG_WRN("Invalid keymap setting: %s", name);
+        return -EINVAL;
+    }
+
+    if (len <= STORED_BINDING_NAME_OFFSET || len > sizeof(struct zmk_keymap_stored_binding)) {
+        LOG_ERR("Invalid binding size for %s (got %d)", name, len);
+        return -EINVAL;
+    }
+
+    struct zmk_keymap_stored_binding stored;
+    int rc = read_cb(cb_arg, &stored, len);
+    if (rc < 0) {
+        return rc;
+    }
+
+    char behavior_dev[BEHAVIOR_NAME_MAX_LEN + 1] = {0};
+    memcpy(behavior_dev, stored.behavior_dev, len - STORED_BINDING_NAME_OFFSET);
+
+    atomic_set_bit(zmk_keymap_stored, KEYMAP_ENTRY(layer, position));
+
+    // Keep the devicetree binding if the behavior is gone, e.g. after flashing a new keymap.
+    int err = set_binding(layer, position, behavior_dev, stored.param1, stored.param2);
+    if (err < 0) {
+        LOG_WRN("Ignoring saved binding for %d on layer %d, unknown behavior %s", position, layer,
+                behavior_dev);
+    }
+
+    return 0;
+}
+
+// Changed bindings are loaded straight into the keymap, so looking them up costs the same. The
+// behaviors are initialized by the time settings are loaded.
+ZMK_SETTINGS_HANDLER_DEFINE(keymap, "keymap", keymap_settings_set);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE) */
+
+static int zmk_keymap_init(void) {
+    for (int layer = 0; layer < ZMK_KEYMAP_LAYERS_LEN; layer++) {
+        for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+            zmk_behavior_binding_resolve(&zmk_keymap[layer][position]);
+        }
+
+#if ZMK_KEYMAP_HAS_SENSORS
+        for (int sensor_index = 0; sensor_index < ZMK_KEYMAP_SENSORS_LEN; sensor_index++) {
+            zmk_behavior_binding_resolve(&zmk_sensor_keymap[layer][sensor_index]);
+        }
+#endif /* ZMK_KEYMAP_HAS_SENSORS */
+    }
+
+    const struct device *transparent = transparent_behavior();
+    for (int position = 0; position < ZMK_KEYMAP_LEN; position++) {
+        update_opaque_layers(position, transparent);
+    }
+
+    memset(zmk_keymap_effective_layer, EFFECTIVE_LAYER_UNKNOWN, sizeof(zmk_keymap_effective_layer));
+
+    return 0;
+}
+
+ZMK_SYS_INIT(zmk_keymap_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 ZMK_LISTENER(keymap, keymap_listener);
 ZMK_SUBSCRIPTION(keymap, zmk_position_state_changed);
 
 #if ZMK_KEYMAP_HAS_SENSORS
 ZMK_SUBSCRIPTION(keymap, zmk_sensor_event);
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE_SHELL)
+
+static int parse_position(const struct shell *sh, char **argv, uint8_t *layer,
+                          uint32_t *position) {
+    char *endptr;
+
+    uint32_t layer_index = strtoul(argv[1], &endptr, 10);
+    if (*endptr != '\0' || layer_index >= ZMK_KEYMAP_LAYERS_LEN) {
+        shell_error(sh, "Invalid layer: %s", argv[1]);
+        return -EINVAL;
+    }
+    *layer = layer_index;
+
+    *position = strtoul(argv[2], &endptr, 10);
+    if (*endptr != '\0' || *position >= ZMK_KEYMAP_LEN) {
+        shell_error(sh, "Invalid position: %s", argv[2]);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int cmd_keymap_show(const struct shell *sh, size_t argc, char **argv) {
+    uint8_t layer;
+    uint32_t position;
+
+    if (parse_position(sh, argv, &layer, &position) < 0) {
+        return -EINVAL;
+    }
+
+    const struct zmk_behavior_binding *binding = zmk_keymap_get_binding(layer, position);
+    shell_print(sh, "%s 0x%x 0x%x%s", binding->behavior_dev, binding->param1, binding->param2,
+                is_default_binding(binding, layer, position) ? "" : " (changed)");
+    return 0;
+}
+
+static int cmd_keymap_bind(const struct shell *sh, size_t argc, char **argv) {
+    uint8_t layer;
+    uint32_t position;
+
+    if (parse_position(sh, argv, &layer, &position) < 0) {
+        return -EINVAL;
+    }
+
+    struct zmk_behavior_binding binding = {
+        .behavior_dev = argv[3],
+        .param1 = argc > 4 ? strtoul(argv[4], NULL, 0) : 0,
+        .param2 = argc > 5 ? strtoul(argv[5], NULL, 0) : 0,
+    };
+
+    int err = zmk_keymap_set_binding(layer, position, &binding);
+    if (err < 0) {
+        shell_error(sh, "Failed to change binding (err %d)", err);
+    }
+    return err;
+}
+
+static int cmd_keymap_reset(const struct shell *sh, size_t argc, char **argv) {
+    uint8_t layer;
+    uint32_t position;
+
+    if (parse_position(sh, argv, &layer, &position) < 0) {
+        return -EINVAL;
+    }
+
+    return zmk_keymap_reset_binding(layer, position);
+}
+
+static int cmd_keymap_save(const struct shell *sh, size_t argc, char **argv) {
+    return zmk_settings_flush();
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_keymap,
+    SHELL_CMD_ARG(show, NULL, "Show a binding: <layer> <position>", cmd_keymap_show, 3, 0),
+    SHELL_CMD_ARG(bind, NULL, "Change a binding: <layer> <position> <behavior> [param1] [param2]",
+                  cmd_keymap_bind, 4, 2),
+    SHELL_CMD_ARG(reset, NULL, "Restore the keymap binding: <layer> <position>", cmd_keymap_reset,
+                  3, 0),
+    SHELL_CMD(save, NULL, "Save changed bindings now", cmd_keymap_save), SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(keymap, &sub_keymap, "Runtime keymap changes", NULL);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE_SHELL) */
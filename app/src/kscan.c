@@ -7,48 +7,108 @@
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/pm/device.h>
+#include <zephyr/sys/math_extras.h>
 #include <zephyr/bluetooth/addr.h>
 #include <zephyr/drivers/kscan.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
+#include <zmk/kscan_batch.h>
+#include <zmk/matrix.h>
 #include <zmk/matrix_transform.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
+#include <zmk/latency_trace.h>
+#include <zmk/position_recorder.h>
 
 #define ZMK_KSCAN_EVENT_STATE_PRESSED 0
 #define ZMK_KSCAN_EVENT_STATE_RELEASED 1
 
 struct zmk_kscan_event {
+    int64_t timestamp;
     uint32_t row;
     uint32_t column;
+    int32_t position;
     uint32_t state;
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE)
+    uint32_t trace_id;
+#endif
 };
 
 struct zmk_kscan_msg_processor {
     struct k_work work;
 } msg_processor;
 
-K_MSGQ_DEFINE(zmk_kscan_msgq, sizeof(struct zmk_kscan_event), CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE, 4);
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_BATCH_CALLBACKS)
+// A single scan can change every key, and all of its changes are queued before any is raised.
+#define ZMK_KSCAN_MSGQ_SIZE MAX(CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE, ZMK_KEYMAP_LEN)
+#else
+#define ZMK_KSCAN_MSGQ_SIZE CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE
+#endif
 
-static void zmk_kscan_callback(const struct device *dev, uint32_t row, uint32_t column,
-                               bool pressed) {
+K_MSGQ_DEFINE(zmk_kscan_msgq, sizeof(struct zmk_kscan_event), ZMK_KSCAN_MSGQ_SIZE, 4);
+
+static void zmk_kscan_queue_event(uint32_t row, uint32_t column, int32_t position, bool pressed,
+                                  int64_t timestamp) {
     struct zmk_kscan_event ev = {
+        .timestamp = timestamp,
         .row = row,
         .column = column,
+        .position = position,
         .state = (pressed ? ZMK_KSCAN_EVENT_STATE_PRESSED : ZMK_KSCAN_EVENT_STATE_RELEASED)};
 
-    k_msgq_put(&zmk_kscan_msgq, &ev, K_NO_WAIT);
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE)
+    ev.trace_id = zmk_latency_trace_begin();
+#endif
+
+    int err = k_msgq_put(&zmk_kscan_msgq, &ev, K_NO_WAIT);
+    if (err < 0) {
+        LOG_ERR("Dropped kscan event for row: %d, col: %d, pressed: %s (err %d)", row, column,
+                (pressed ? "true" : "false"), err);
+    }
+}
+
+static void zmk_kscan_callback(const struct device *dev, uint32_t row, uint32_t column,
+                               bool pressed) {
+    zmk_kscan_queue_event(row, column, zmk_matrix_transform_row_column_to_position(row, column),
+                          pressed, k_uptime_get());
+    k_work_submit(&msg_processor.work);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_BATCH_CALLBACKS)
+static void zmk_kscan_batch_callback(const struct device *dev, int64_t timestamp,
+                                     const struct zmk_kscan_changes *changes, size_t len,
+                                     const struct zmk_kscan_positions *positions) {
+    for (size_t i = 0; i < len; i++) {
+        uint32_t changed = changes[i].changed;
+
+        while (changed) {
+            const int bit = u32_count_trailing_zeros(changed);
+            const uint32_t row = changes[i].row + (changes[i].vertical ? bit : 0);
+            const uint32_t column = changes[i].column + (changes[i].vertical ? 0 : bit);
+
+            const int32_t position =
+                positions ? zmk_kscan_positions_get(positions, row, column)
+                          : zmk_matrix_transform_row_column_to_position(row, column);
+
+            zmk_kscan_queue_event(row, column, position, changes[i].pressed & BIT(bit), timestamp);
+
+            changed &= changed - 1;
+        }
+    }
+
+    // All events from the scan are raised by the same run of the work item.
     k_work_submit(&msg_processor.work);
 }
+#endif
 
 void zmk_kscan_process_msgq(struct k_work *item) {
     struct zmk_kscan_event ev;
 
     while (k_msgq_get(&zmk_kscan_msgq, &ev, K_NO_WAIT) == 0) {
         bool pressed = (ev.state == ZMK_KSCAN_EVENT_STATE_PRESSED);
-        int32_t position = zmk_matrix_transform_row_column_to_position(ev.row, ev.column);
+        int32_t position = ev.position;
 
         if (position < 0) {
             LOG_WRN("Not found in transform: row: %d, col: %d, pressed: %s", ev.row, ev.column,
@@ -58,11 +118,18 @@ void zmk_kscan_process_msgq(struct k_work *item) {
 
         LOG_DBG("Row: %d, col: %d, position: %d, pressed: %s", ev.row, ev.column, position,
                 (pressed ? "true" : "false"));
-        raise_zmk_position_state_changed(
-            (struct zmk_position_state_changed){.source = ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL,
-                                                .state = pressed,
-                                                .position = position,
-                                                .timestamp = k_uptime_get()});
+        struct zmk_position_state_changed pos_ev = {
+            .source = ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL,
+            .state = pressed,
+            .position = position,
+            .timestamp = ev.timestamp,
+        };
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE)
+        pos_ev.trace_id = ev.trace_id;
+        zmk_latency_trace_mark(ev.trace_id, ZMK_LATENCY_TRACE_STAGE_MSGQ);
+#endif
+        zmk_position_recorder_record(&pos_ev);
+        raise_zmk_position_state_changed(pos_ev);
     }
 }
 
@@ -80,6 +147,11 @@ int zmk_kscan_init(const struct device *dev) {
     }
 #endif // IS_ENABLED(CONFIG_PM_DEVICE)
 
+#if IS_ENABLED(CONFIG_ZMK_KSCAN_BATCH_CALLBACKS)
+    zmk_kscan_batch_config(dev, zmk_kscan_batch_callback,
+                           zmk_matrix_transform_row_column_to_position);
+#endif
+
     kscan_config(dev, zmk_kscan_callback);
     kscan_enable_callback(dev);
 
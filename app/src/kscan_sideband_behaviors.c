@@ -129,6 +129,11 @@ static int ksbb_init(const struct device *dev) {
         return -ENODEV;
     }
 
+    // Behaviors are initialized at POST_KERNEL, so they are ready by now.
+    for (int e = 0; e < config->entries_len; e++) {
+        zmk_behavior_binding_resolve(&config->entries[e].binding);
+    }
+
     kscan_config(config->kscan, &ksbb_inner_kscan_callback);
     kscan_enable_callback(config->kscan);
 
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE_SHELL)
+#include <zephyr/shell/shell.h>
+#endif
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/latency_trace.h>
+
+struct latency_trace {
+    // 0 while the slot is unused or being rewritten
+    uint32_t id;
+    uint8_t marked;
+    uint32_t cycles[ZMK_LATENCY_TRACE_STAGES];
+};
+
+struct latency_stats {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+};
+
+static const char *const stage_names[ZMK_LATENCY_TRACE_STAGES] = {
+    [ZMK_LATENCY_TRACE_STAGE_KSCAN] = "kscan",   [ZMK_LATENCY_TRACE_STAGE_MSGQ] = "msgq",
+    [ZMK_LATENCY_TRACE_STAGE_KEYMAP] = "keymap", [ZMK_LATENCY_TRACE_STAGE_HID] = "hid",
+    [ZMK_LATENCY_TRACE_STAGE_REPORT] = "report",
+};
+
+// Each trace is only written by the stage that reaches it, and every stage of a key event
+// happens after the previous one, so slots are filled without locks. A reader may see a
+// trace that is still being filled, which only leaves it out of the stages not marked yet.
+static struct latency_trace traces[CONFIG_ZMK_LATENCY_TRACE_BUFFER_SIZE];
+static atomic_t last_id = ATOMIC_INIT(0);
+static atomic_t current_id = ATOMIC_INIT(0);
+
+// scratch space for sorting, only used while holding stats_lock
+static uint32_t samples[CONFIG_ZMK_LATENCY_TRACE_BUFFER_SIZE];
+static K_MUTEX_DEFINE(stats_lock);
+
+#if CONFIG_ZMK_LATENCY_TRACE_LOG_INTERVAL > 0
+static void log_work_handler(struct k_work *work) { zmk_latency_trace_log(); }
+
+static K_WORK_DEFINE(log_work, log_work_handler);
+#endif
+
+static inline struct latency_trace *trace_for_id(uint32_t id) {
+    return &traces[id % ARRAY_SIZE(traces)];
+}
+
+uint32_t zmk_latency_trace_begin(void) {
+    uint32_t id;
+    do {
+        id = (uint32_t)atomic_inc(&last_id) + 1;
+    } while (id == 0);
+
+    struct latency_trace *trace = trace_for_id(id);
+    trace->id = 0;
+    trace->cycles[ZMK_LATENCY_TRACE_STAGE_KSCAN] = k_cycle_get_32();
+    trace->marked = BIT(ZMK_LATENCY_TRACE_STAGE_KSCAN);
+    trace->id = id;
+
+#if CONFIG_ZMK_LATENCY_TRACE_LOG_INTERVAL > 0
+    if (id % CONFIG_ZMK_LATENCY_TRACE_LOG_INTERVAL == 0) {
+        k_work_submit(&log_work);
+    }
+#endif
+
+    return id;
+}
+
+void zmk_latency_trace_mark(uint32_t id, enum zmk_latency_trace_stage stage) {
+    if (id == 0) {
+        return;
+    }
+
+    struct latency_trace *trace = trace_for_id(id);
+    // only the first time a stage is reached counts, later reports for the same key event
+    // were caused by something else.
+    if (trace->id != id || (trace->marked & BIT(stage))) {
+        return;
+    }
+
+    trace->cycles[stage] = k_cycle_get_32();
+    trace->marked |= BIT(stage);
+}
+
+void zmk_latency_trace_set_current(uint32_t id) { atomic_set(&current_id, id); }
+
+void zmk_latency_trace_mark_current(enum zmk_latency_trace_stage stage) {
+    zmk_latency_trace_mark((uint32_t)atomic_get(&current_id), stage);
+}
+
+static void sort_samples(uint32_t count) {
+    // insertion sort, the buffer is small and this only runs on request
+    for (uint32_t i = 1; i < count; i++) {
+        uint32_t sample = samples[i];
+        uint32_t j = i;
+        for (; j > 0 && samples[j - 1] > sample; j--) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = sample;
+    }
+}
+
+static inline uint32_t percentile(uint32_t count, uint32_t pct) {
+    return samples[(count - 1) * pct / 100];
+}
+
+// time from the kscan callback until the given stage, over all traces that reached it
+static struct latency_stats get_stats(enum zmk_latency_trace_stage stage) {
+    struct latency_stats stats = {0};
+    uint8_t required = BIT(ZMK_LATENCY_TRACE_STAGE_KSCAN) | BIT(stage);
+
+    for (int i = 0; i < ARRAY_SIZE(traces); i++) {
+        struct latency_trace *trace = &traces[i];
+        if (trace->id == 0 || (trace->marked & required) != required) {
+            continue;
+        }
+
+        uint32_t cycles = trace->cycles[stage] - trace->cycles[ZMK_LATENCY_TRACE_STAGE_KSCAN];
+        samples[stats.count++] = k_cyc_to_us_floor32(cycles);
+    }
+
+    if (stats.count == 0) {
+        return stats;
+    }
+
+    sort_samples(stats.count);
+    stats.p50_us = percentile(stats.count, 50);
+    stats.p90_us = percentile(stats.count, 90);
+    stats.p99_us = percentile(stats.count, 99);
+    stats.max_us = samples[stats.count - 1];
+    return stats;
+}
+
+void zmk_latency_trace_log(void) {
+    k_mutex_lock(&stats_lock, K_FOREVER);
+    for (int stage = ZMK_LATENCY_TRACE_STAGE_KSCAN + 1; stage < ZMK_LATENCY_TRACE_STAGES;
+         stage++) {
+        struct latency_stats stats = get_stats(stage);
+        LOG_INF("latency to %s: n=%u p50=%uus p90=%uus p99=%uus max=%uus", stage_names[stage],
+                stats.count, stats.p50_us, stats.p90_us, stats.p99_us, stats.max_us);
+    }
+    k_mutex_unlock(&stats_lock);
+}
+
+void zmk_latency_trace_reset(void) {
+    for (int i = 0; i < ARRAY_SIZE(traces); i++) {
+        traces[i].id = 0;
+    }
+}
+
+#if IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE_SHELL)
+
+static int cmd_latency_show(const struct shell *sh, size_t argc, char **argv) {
+    shell_print(sh, "%-8s %8s %10s %10s %10s %10s", "stage", "count", "p50 (us)", "p90 (us)",
+                "p99 (us)", "max (us)");
+
+    k_mutex_lock(&stats_lock, K_FOREVER);
+    for (int stage = ZMK_LATENCY_TRACE_STAGE_KSCAN + 1; stage < ZMK_LATENCY_TRACE_STAGES;
+         stage++) {
+        struct latency_stats stats = get_stats(stage);
+        shell_print(sh, "%-8s %8u %10u %10u %10u %10u", stage_names[stage], stats.count,
+                    stats.p50_us, stats.p90_us, stats.p99_us, stats.max_us);
+    }
+    k_mutex_unlock(&stats_lock);
+
+    return 0;
+}
+
+static int cmd_latency_reset(const struct shell *sh, size_t argc, char **argv) {
+    zmk_latency_trace_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_latency,
+                               SHELL_CMD(show, NULL, "Show latency percentiles per stage",
+                                         cmd_latency_show),
+                               SHELL_CMD(reset, NULL, "Clear all traces", cmd_latency_reset),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(latency, &sub_latency, "Key event latency tracing", NULL);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_LATENCY_TRACE_SHELL) */
@@ -15,6 +15,8 @@ LOG_MODULE_REGISTER(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/matrix.h>
 #include <zmk/kscan.h>
 #include <zmk/display.h>
+#include <zmk/boot_profiler.h>
+#include <zmk/deferred_init.h>
 #include <drivers/ext_power.h>
 
 #ifdef CONFIG_ZMK_MOUSE
@@ -28,9 +30,16 @@ int main(void) {
         return -ENOTSUP;
     }
 
-#ifdef CONFIG_ZMK_DISPLAY
+    // Boot time until keys are read, which is what a wake from soft off waits for.
+    LOG_INF("Scanning keys %u us after boot", k_ticks_to_us_floor32(k_uptime_ticks()));
+    zmk_boot_profiler_scan_started();
+
+#if IS_ENABLED(CONFIG_ZMK_DEFERRED_INIT)
+    // The display, underglow, battery and sensors are set up while keys are already handled.
+    zmk_deferred_init_start();
+#elif IS_ENABLED(CONFIG_ZMK_DISPLAY)
     zmk_display_init();
-#endif /* CONFIG_ZMK_DISPLAY */
+#endif
 
     return 0;
 }
@@ -32,7 +32,7 @@
     [(KT_ROW(DT_PROP_BY_IDX(ZMK_KEYMAP_TRANSFORM_NODE, map, i)) * ZMK_MATRIX_COLS) +               \
         KT_COL(DT_PROP_BY_IDX(ZMK_KEYMAP_TRANSFORM_NODE, map, i))] = i + INDEX_OFFSET
 
-static uint32_t transform[] = {LISTIFY(ZMK_KEYMAP_LEN, TRANSFORM_ENTRY, (, ), 0)};
+static const uint16_t transform[] = {LISTIFY(ZMK_KEYMAP_LEN, TRANSFORM_ENTRY, (, ), 0)};
 
 #endif
 
@@ -63,3 +63,30 @@ int32_t zmk_matrix_transform_row_column_to_position(uint32_t row, uint32_t colum
     return matrix_index;
 #endif /* ZMK_KEYMAP_TRANSFORM_NODE */
 };
+
+int zmk_matrix_transform_position_to_row_column(uint32_t position, uint32_t *row,
+                                                uint32_t *column) {
+    if (position >= ZMK_KEYMAP_LEN) {
+        return -EINVAL;
+    }
+
+#ifdef ZMK_KEYMAP_TRANSFORM_NODE
+    static const uint16_t map[] = DT_PROP(ZMK_KEYMAP_TRANSFORM_NODE, map);
+
+    *row = KT_ROW(map[position]);
+    *column = KT_COL(map[position]);
+#else
+    *row = position / ZMK_MATRIX_COLS;
+    *column = position % ZMK_MATRIX_COLS;
+#endif /* ZMK_KEYMAP_TRANSFORM_NODE */
+
+#if DT_NODE_HAS_PROP(ZMK_KEYMAP_TRANSFORM_NODE, col_offset)
+    *column -= DT_PROP(ZMK_KEYMAP_TRANSFORM_NODE, col_offset);
+#endif
+
+#if DT_NODE_HAS_PROP(ZMK_KEYMAP_TRANSFORM_NODE, row_offset)
+    *row -= DT_PROP(ZMK_KEYMAP_TRANSFORM_NODE, row_offset);
+#endif
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/logging/log.h>
+
+#if IS_ENABLED(CONFIG_ZMK_POSITION_RECORDER_SHELL)
+#include <zephyr/shell/shell.h>
+#endif
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/matrix_transform.h>
+#include <zmk/position_recorder.h>
+
+// 8 bytes per event. Millisecond timestamps wrap after 49 days, which is far longer than a
+// buffer's worth of typing.
+struct position_record {
+    uint32_t timestamp;
+    uint16_t position;
+    uint8_t source;
+    bool state;
+};
+
+// "<timestamp> <d|u> <row> <column> # peripheral <source>"
+#define RECORD_LINE_LEN 48
+
+static struct position_record records[CONFIG_ZMK_POSITION_RECORDER_BUFFER_SIZE];
+// Number of events ever recorded. The next event goes to records[count % ARRAY_SIZE(records)].
+static uint32_t count;
+static struct k_spinlock lock;
+
+#if CONFIG_ZMK_POSITION_RECORDER_LOG_INTERVAL > 0
+// Sequence number of the first event the log work has not logged yet.
+static uint32_t logged;
+
+static uint32_t log_records(uint32_t seq);
+
+static void log_work_handler(struct k_work *work) { logged = log_records(logged); }
+
+static K_WORK_DEFINE(log_work, log_work_handler);
+#endif
+
+void zmk_position_recorder_record(const struct zmk_position_state_changed *ev) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    records[count % ARRAY_SIZE(records)] = (struct position_record){
+        .timestamp = (uint32_t)ev->timestamp,
+        .position = ev->position,
+        .source = ev->source,
+        .state = ev->state,
+    };
+    count++;
+    k_spin_unlock(&lock, key);
+
+#if CONFIG_ZMK_POSITION_RECORDER_LOG_INTERVAL > 0
+    if (count % CONFIG_ZMK_POSITION_RECORDER_LOG_INTERVAL == 0) {
+        k_work_submit(&log_work);
+    }
+#endif
+}
+
+void zmk_position_recorder_clear(void) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    count = 0;
+#if CONFIG_ZMK_POSITION_RECORDER_LOG_INTERVAL > 0
+    logged = 0;
+#endif
+    k_spin_unlock(&lock, key);
+}
+
+// Copies out the record with the given sequence number, if it has not been overwritten yet.
+static bool get_record(uint32_t seq, struct position_record *record) {
+    bool found = false;
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    if (seq < count && count - seq <= ARRAY_SIZE(records)) {
+        *record = records[seq % ARRAY_SIZE(records)];
+        found = true;
+    }
+    k_spin_unlock(&lock, key);
+
+    return found;
+}
+
+static uint32_t first_record(void) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint32_t first = count > ARRAY_SIZE(records) ? count - ARRAY_SIZE(records) : 0;
+    k_spin_unlock(&lock, key);
+
+    return first;
+}
+
+// Formats a record as a line the kscan-mock-stream driver can replay. The source is a comment.
+static void format_record(const struct position_record *record, char *line, size_t len) {
+    uint32_t row, column;
+
+    if (zmk_matrix_transform_position_to_row_column(record->position, &row, &column) < 0) {
+        snprintf(line, len, "# %u: position %u is not in the matrix", record->timestamp,
+                 record->position);
+        return;
+    }
+
+    if (record->source == ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL) {
+        snprintf(line, len, "%u %c %u %u # local", record->timestamp, record->state ? 'd' : 'u',
+                 row, column);
+    } else {
+        snprintf(line, len, "%u %c %u %u # peripheral %u", record->timestamp,
+                 record->state ? 'd' : 'u', row, column, record->source);
+    }
+}
+
+// Logs the records from seq on, and returns the sequence number after the last one logged.
+// Events recorded while logging are included, events overwritten while logging are not.
+static uint32_t log_records(uint32_t seq) {
+    struct position_record record;
+    char line[RECORD_LINE_LEN];
+
+    seq = MAX(seq, first_record());
+    for (; get_record(seq, &record); seq++) {
+        format_record(&record, line, sizeof(line));
+        LOG_INF("%s", line);
+    }
+
+    return seq;
+}
+
+void zmk_position_recorder_log(void) { log_records(first_record()); }
+
+#if IS_ENABLED(CONFIG_ZMK_POSITION_RECORDER_SHELL)
+
+static int cmd_recorder_dump(const struct shell *sh, size_t argc, char **argv) {
+    struct position_record record;
+    char line[RECORD_LINE_LEN];
+
+    for (uint32_t seq = first_record(); get_record(seq, &record); seq++) {
+        format_record(&record, line, sizeof(line));
+        shell_print(sh, "%s", line);
+    }
+
+    return 0;
+}
+
+static int cmd_recorder_log(const struct shell *sh, size_t argc, char **argv) {
+    zmk_position_recorder_log();
+    return 0;
+}
+
+static int cmd_recorder_clear(const struct shell *sh, size_t argc, char **argv) {
+    zmk_position_recorder_clear();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_recorder, SHELL_CMD(dump, NULL, "Print the recorded key position events", cmd_recorder_dump),
+    SHELL_CMD(log, NULL, "Log the recorded key position events", cmd_recorder_log),
+    SHELL_CMD(clear, NULL, "Discard the recorded key position events", cmd_recorder_clear),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(recorder, &sub_recorder, "Key position event recorder", NULL);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_POSITION_RECORDER_SHELL) */
@@ -20,11 +20,13 @@
 #include <zmk/rgb_underglow.h>
 
 #include <zmk/activity.h>
+#include <zmk/settings.h>
 #include <zmk/usb.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/activity_state_changed.h>
 #include <zmk/events/usb_conn_state_changed.h>
 #include <zmk/workqueue.h>
+#include <zmk/deferred_init.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -64,7 +66,19 @@ static const struct device *led_strip;
 
 static struct led_rgb pixels[STRIP_NUM_PIXELS];
 
-static struct rgb_underglow_state state;
+// Settings are loaded before init, so the defaults are set here rather than in init.
+static struct rgb_underglow_state state = {
+    .color =
+        {
+            .h = CONFIG_ZMK_RGB_UNDERGLOW_HUE_START,
+            .s = CONFIG_ZMK_RGB_UNDERGLOW_SAT_START,
+            .b = CONFIG_ZMK_RGB_UNDERGLOW_BRT_START,
+        },
+    .animation_speed = CONFIG_ZMK_RGB_UNDERGLOW_SPD_START,
+    .current_effect = CONFIG_ZMK_RGB_UNDERGLOW_EFF_START,
+    .animation_step = 0,
+    .on = IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_ON_START),
+};
 
 #if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_EXT_POWER)
 static const struct device *const ext_power = DEVICE_DT_GET(DT_INST(0, zmk_ext_power_generic));
@@ -230,13 +244,9 @@ static int rgb_settings_set(const char *name, size_t len, settings_read_cb read_
     return -ENOENT;
 }
 
-struct settings_handler rgb_conf = {.name = "rgb/underglow", .h_set = rgb_settings_set};
-
-static void zmk_rgb_underglow_save_state_work(struct k_work *_work) {
-    settings_save_one("rgb/underglow/state", &state, sizeof(state));
-}
+ZMK_SETTINGS_HANDLER_DEFINE(rgb_underglow, "rgb/underglow", rgb_settings_set);
 
-static struct k_work_delayable underglow_save_work;
+ZMK_SETTINGS_ENTRY_DEFINE(underglow_state_setting, "rgb/underglow/state", &state, sizeof(state));
 #endif
 
 static int zmk_rgb_underglow_init(void) {
@@ -249,32 +259,6 @@ static int zmk_rgb_underglow_init(void) {
     }
 #endif
 
-    state = (struct rgb_underglow_state){
-        color : {
-            h : CONFIG_ZMK_RGB_UNDERGLOW_HUE_START,
-            s : CONFIG_ZMK_RGB_UNDERGLOW_SAT_START,
-            b : CONFIG_ZMK_RGB_UNDERGLOW_BRT_START,
-        },
-        animation_speed : CONFIG_ZMK_RGB_UNDERGLOW_SPD_START,
-        current_effect : CONFIG_ZMK_RGB_UNDERGLOW_EFF_START,
-        animation_step : 0,
-        on : IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_ON_START)
-    };
-
-#if IS_ENABLED(CONFIG_SETTINGS)
-    settings_subsys_init();
-
-    int err = settings_register(&rgb_conf);
-    if (err) {
-        LOG_ERR("Failed to register the ext_power settings handler (err %d)", err);
-        return err;
-    }
-
-    k_work_init_delayable(&underglow_save_work, zmk_rgb_underglow_save_state_work);
-
-    settings_load_subtree("rgb/underglow");
-#endif
-
 #if IS_ENABLED(CONFIG_ZMK_RGB_UNDERGLOW_AUTO_OFF_USB)
     state.on = zmk_usb_is_powered();
 #endif
@@ -288,8 +272,7 @@ static int zmk_rgb_underglow_init(void) {
 
 int zmk_rgb_underglow_save_state(void) {
 #if IS_ENABLED(CONFIG_SETTINGS)
-    int ret = k_work_reschedule(&underglow_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
-    return MIN(ret, 0);
+    return zmk_settings_mark_dirty(&underglow_state_setting);
 #else
     return 0;
 #endif
@@ -526,4 +509,4 @@ ZMK_SUBSCRIPTION(rgb_underglow, zmk_activity_state_changed);
 ZMK_SUBSCRIPTION(rgb_underglow, zmk_usb_conn_state_changed);
 #endif
 
-SYS_INIT(zmk_rgb_underglow_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+ZMK_DEFERRED_INIT(zmk_rgb_underglow_init);
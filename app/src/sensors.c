@@ -15,6 +15,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/sensors.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/sensor_event.h>
+#include <zmk/deferred_init.h>
 
 #if ZMK_KEYMAP_HAS_SENSORS
 
@@ -146,6 +147,6 @@ static int zmk_sensors_init(void) {
     return 0;
 }
 
-SYS_INIT(zmk_sensors_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+ZMK_DEFERRED_INIT(zmk_sensors_init);
 
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/shell/shell_dummy.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <dt-bindings/zmk/keys.h>
+#include <zmk/boot_profiler.h>
+#include <zmk/keymap.h>
+
+// Mirrors the layout keymap.c saves bindings with.
+struct stored_binding {
+    uint32_t param1;
+    uint32_t param2;
+    char behavior_dev[sizeof("key_press") - 1];
+} __packed;
+
+// A binding saved by an earlier boot, so loading it is tested too.
+static const struct stored_binding saved_binding = {
+    .param1 = E,
+    .behavior_dev = "key_press",
+};
+
+static ssize_t read_saved_binding(void *cb_arg, void *data, size_t len) {
+    len = MIN(len, sizeof(saved_binding));
+    memcpy(data, &saved_binding, len);
+    return len;
+}
+
+static int test_store_load(struct settings_store *cs, const struct settings_load_arg *arg) {
+    LOG_DBG("keymap settings test: load keymap/0/3");
+    return settings_call_set_handler("keymap/0/3", sizeof(saved_binding), read_saved_binding,
+                                     NULL, arg);
+}
+
+// Writes are only logged, so the test shows which settings a flush writes.
+static int test_store_save(struct settings_store *cs, const char *name, const char *value,
+                           size_t val_len) {
+    if (val_len == 0) {
+        LOG_DBG("keymap settings test: delete %s", name);
+    } else {
+        LOG_DBG("keymap settings test: save %s (%zu bytes)", name, val_len);
+    }
+    return 0;
+}
+
+static const struct settings_store_itf test_store_itf = {
+    .csi_load = test_store_load,
+    .csi_save = test_store_save,
+};
+
+static struct settings_store test_store = {.cs_itf = &test_store_itf};
+
+int settings_backend_init(void) {
+    settings_src_register(&test_store);
+    settings_dst_register(&test_store);
+    return 0;
+}
+
+static const char *const commands[] = {
+    "keymap bind 0 0 key_press 0x70009", // F
+    "keymap bind 0 1 key_press 0x7000a", // G, reset before it is saved
+    "keymap reset 0 1",
+    "keymap reset 0 3",
+    "keymap show 0 0",
+    "keymap show 0 1",
+    "keymap save",
+};
+
+static void log_shell_output(const struct shell *sh) {
+    size_t len;
+    char *output = (char *)shell_backend_dummy_get_output(sh, &len);
+
+    for (char *line = strtok(output, "\r\n"); line != NULL; line = strtok(NULL, "\r\n")) {
+        LOG_DBG("keymap settings test: > %s", line);
+    }
+}
+
+static void run_commands(struct k_work *work) {
+    const struct shell *sh = shell_backend_dummy_get_ptr();
+    const struct zmk_behavior_binding *loaded = zmk_keymap_get_binding(0, 3);
+
+    LOG_DBG("keymap settings test: 0/3 is %s 0x%x, %s", loaded->behavior_dev, loaded->param1,
+            loaded->resolved_dev != NULL ? "resolved" : "not resolved");
+
+    for (int i = 0; i < ARRAY_SIZE(commands); i++) {
+        LOG_DBG("keymap settings test: run %s", commands[i]);
+        int err = shell_execute_cmd(sh, commands[i]);
+        log_shell_output(sh);
+        if (err < 0) {
+            LOG_DBG("keymap settings test: failed (err %d)", err);
+        }
+    }
+}
+
+static K_WORK_DELAYABLE_DEFINE(run_commands_work, run_commands);
+
+static int keymap_settings_test_init(void) {
+    k_work_schedule(&run_commands_work, K_MSEC(CONFIG_ZMK_KEYMAP_SETTINGS_STORAGE_TEST_DELAY));
+    return 0;
+}
+
+ZMK_SYS_INIT(keymap_settings_test_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/settings.h>
+#include <zmk/boot_profiler.h>
+
+static uint32_t loaded;
+
+static int zmk_settings_load_cb(const char *key, size_t len, settings_read_cb read_cb,
+                                void *cb_arg, void *param) {
+    STRUCT_SECTION_FOREACH(zmk_settings_handler, handler) {
+        const char *next;
+        if (settings_name_steq(key, handler->name, &next)) {
+            loaded++;
+            // A non-zero return would stop the walk and skip every later setting, so errors,
+            // such as a stale key left by an older keymap, only fail their own setting.
+            int err = handler->set(next, len, read_cb, cb_arg);
+            if (err < 0) {
+                LOG_WRN("Failed to load setting %s (err %d)", key, err);
+            }
+            return 0;
+        }
+    }
+
+    // Settings ZMK does not own, such as Bluetooth keys, are loaded by their own subsystem.
+    return 0;
+}
+
+// Walking the settings store is the slow part of loading settings, so all of ZMK's settings are
+// dispatched from a single walk instead of one per subtree.
+static int zmk_settings_load(void) {
+    uint32_t start = k_cycle_get_32();
+
+    int err = settings_subsys_init();
+    if (err < 0) {
+        LOG_ERR("Failed to initialize settings (err %d)", err);
+        return err;
+    }
+
+    err = settings_load_subtree_direct(NULL, zmk_settings_load_cb, NULL);
+    if (err < 0) {
+        LOG_ERR("Failed to load settings (err %d)", err);
+        return err;
+    }
+
+    LOG_INF("Loaded %u settings in %u us", loaded,
+            k_cyc_to_us_floor32(k_cycle_get_32() - start));
+    return 0;
+}
+
+ZMK_SYS_INIT(zmk_settings_load, POST_KERNEL, CONFIG_ZMK_SETTINGS_LOAD_INIT_PRIORITY);
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2024 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/spinlock.h>
+
+#if IS_ENABLED(CONFIG_ZMK_SETTINGS_WRITER_SHELL)
+#include <zephyr/shell/shell.h>
+#endif
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/settings.h>
+#include <zmk/workqueue.h>
+
+static sys_slist_t dirty_entries = SYS_SLIST_STATIC_INIT(&dirty_entries);
+// Entries whose write failed during the current flush. Only used with flush_mutex held.
+static sys_slist_t failed_entries = SYS_SLIST_STATIC_INIT(&failed_entries);
+// Protects dirty_entries, the entries' dirty flags and the counters.
+static struct k_spinlock lock;
+// Keeps a flush before power off from interleaving with one from the work queue.
+static K_MUTEX_DEFINE(flush_mutex);
+
+static struct zmk_settings_writer_stats stats;
+
+static void settings_flush_work_handler(struct k_work *work) { zmk_settings_flush(); }
+
+static K_WORK_DELAYABLE_DEFINE(settings_flush_work, settings_flush_work_handler);
+
+int zmk_settings_mark_dirty(struct zmk_settings_entry *entry) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    stats.marked++;
+    if (entry->dirty) {
+        stats.avoided++;
+    } else {
+        entry->dirty = true;
+        sys_slist_append(&dirty_entries, &entry->node);
+    }
+    k_spin_unlock(&lock, key);
+
+    int ret = k_work_reschedule_for_queue(zmk_workqueue_lowprio_work_q(), &settings_flush_work,
+                                          K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
+    return MIN(ret, 0);
+}
+
+static struct zmk_settings_entry *take_dirty_entry(void) {
+    struct zmk_settings_entry *entry = NULL;
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    sys_snode_t *node = sys_slist_get(&dirty_entries);
+    if (node != NULL) {
+        entry = CONTAINER_OF(node, struct zmk_settings_entry, node);
+        entry->dirty = false;
+    }
+    k_spin_unlock(&lock, key);
+
+    return entry;
+}
+
+static int write_entry(const struct zmk_settings_entry *entry) {
+    uint8_t value[ZMK_SETTINGS_VALUE_MAX_LEN];
+
+    if (entry->save != NULL) {
+        return entry->save();
+    }
+
+    // Values are owned by code running on higher priority threads. Copying them with the
+    // scheduler locked keeps a change from landing halfway through the copy. A change made after
+    // the copy marks the entry again, so it is written by the next flush.
+    k_sched_lock();
+    memcpy(value, entry->value, entry->len);
+    k_sched_unlock();
+
+    return settings_save_one(entry->name, value, entry->len);
+}
+
+int zmk_settings_flush(void) {
+    struct zmk_settings_entry *entry;
+    int ret = 0;
+
+    k_work_cancel_delayable(&settings_flush_work);
+
+    k_mutex_lock(&flush_mutex, K_FOREVER);
+    while ((entry = take_dirty_entry()) != NULL) {
+        int err = write_entry(entry);
+
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        if (err < 0) {
+            stats.failed++;
+            // Kept aside until the loop is done, so the flush doesn't retry it right away. An
+            // entry marked again during the write is already back on the dirty list.
+            if (!entry->dirty) {
+                entry->dirty = true;
+                sys_slist_append(&failed_entries, &entry->node);
+            }
+        } else {
+            stats.written++;
+        }
+        k_spin_unlock(&lock, key);
+
+        if (err < 0) {
+            LOG_ERR("Failed to save setting %s (err %d)", entry->name, err);
+            ret = err;
+        }
+    }
+
+    if (ret < 0) {
+        k_spinlock_key_t key = k_spin_lock(&lock);
+        sys_slist_merge_slist(&dirty_entries, &failed_entries);
+        k_spin_unlock(&lock, key);
+
+        // failed entries are written again with the next flush
+        k_work_reschedule_for_queue(zmk_workqueue_lowprio_work_q(), &settings_flush_work,
+                                    K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
+    }
+    k_mutex_unlock(&flush_mutex);
+
+    struct zmk_settings_writer_stats current;
+    zmk_settings_writer_get_stats(&current);
+    LOG_DBG("Settings marked %u, written %u, writes avoided %u, failed %u", current.marked,
+            current.written, current.avoided, current.failed);
+
+    return ret;
+}
+
+void zmk_settings_writer_get_stats(struct zmk_settings_writer_stats *out) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_SETTINGS_WRITER_SHELL)
+
+static int cmd_settings_writer_stats(const struct shell *sh, size_t argc, char **argv) {
+    struct zmk_settings_writer_stats current;
+
+    zmk_settings_writer_get_stats(&current);
+    shell_print(sh, "marked %u, written %u, writes avoided %u, failed %u", current.marked,
+                current.written, current.avoided, current.failed);
+    return 0;
+}
+
+static int cmd_settings_writer_flush(const struct shell *sh, size_t argc, char **argv) {
+    return zmk_settings_flush();
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_settings_writer,
+                               SHELL_CMD(stats, NULL, "Show settings write counters",
+                                         cmd_settings_writer_stats),
+                               SHELL_CMD(flush, NULL, "Write changed settings now",
+                                         cmd_settings_writer_flush),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(settings_writer, &sub_settings_writer, "Coalesced settings writes", NULL);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_SETTINGS_WRITER_SHELL) */
@@ -26,14 +26,34 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/split/bluetooth/service.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
+#include <zmk/position_recorder.h>
 #include <zmk/events/sensor_event.h>
 #include <zmk/events/battery_state_changed.h>
 #include <zmk/hid_indicators_types.h>
+#include <zmk/boot_profiler.h>
 
 static int start_scanning(void);
 
 #define POSITION_STATE_DATA_LEN 16
 
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
+#define CLOCK_OFFSET_WINDOW 32
+
+// Estimates our uptime minus a peripheral's, modulo 2^32 ms. Each notification gives a sample
+// of that offset plus the time it took to arrive, which varies with the connection interval.
+// The smallest sample saw the least delay, so using it keeps that jitter out of the event
+// timestamps. The minimum is taken over the current and the previous window of samples, so
+// the estimate follows clock drift between the halves.
+struct clock_offset {
+    uint32_t window_min;
+    uint32_t previous_min;
+    uint8_t window_samples;
+    bool has_previous;
+};
+
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
 enum peripheral_slot_state {
     PERIPHERAL_SLOT_STATE_OPEN,
     PERIPHERAL_SLOT_STATE_CONNECTING,
@@ -45,6 +65,9 @@ struct peripheral_slot {
     struct bt_conn *conn;
     struct bt_gatt_discover_params discover_params;
     struct bt_gatt_subscribe_params subscribe_params;
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+    struct bt_gatt_subscribe_params events_subscribe_params;
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
     struct bt_gatt_subscribe_params sensor_subscribe_params;
     struct bt_gatt_discover_params sub_discover_params;
     uint16_t run_behavior_handle;
@@ -57,6 +80,9 @@ struct peripheral_slot {
 #endif // IS_ENABLED(CONFIG_ZMK_SPLIT_PERIPHERAL_HID_INDICATORS)
     uint8_t position_state[POSITION_STATE_DATA_LEN];
     uint8_t changed_positions[POSITION_STATE_DATA_LEN];
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+    struct clock_offset clock_offset;
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
 };
 
 static struct peripheral_slot peripherals[ZMK_SPLIT_BLE_PERIPHERAL_COUNT];
@@ -72,6 +98,7 @@ void peripheral_event_work_callback(struct k_work *work) {
     struct zmk_position_state_changed ev;
     while (k_msgq_get(&peripheral_event_msgq, &ev, K_NO_WAIT) == 0) {
         LOG_DBG("Trigger key position state change for %d", ev.position);
+        zmk_position_recorder_record(&ev);
         raise_zmk_position_state_changed(ev);
     }
 }
@@ -137,8 +164,15 @@ int release_peripheral_slot(int index) {
         slot->changed_positions[i] = 0U;
     }
 
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+    slot->clock_offset = (struct clock_offset){0};
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
     // Clean up previously discovered handles;
     slot->subscribe_params.value_handle = 0;
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+    slot->events_subscribe_params.value_handle = 0;
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
     slot->run_behavior_handle = 0;
 #if IS_ENABLED(CONFIG_ZMK_SPLIT_PERIPHERAL_HID_INDICATORS)
     slot->update_hid_indicators = 0;
@@ -270,6 +304,92 @@ static uint8_t split_central_notify_func(struct bt_conn *conn,
     return BT_GATT_ITER_CONTINUE;
 }
 
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
+static inline bool clock_offset_before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+static void clock_offset_add_sample(struct clock_offset *offset, uint32_t sample) {
+    if (offset->window_samples == 0 || clock_offset_before(sample, offset->window_min)) {
+        offset->window_min = sample;
+    }
+
+    if (++offset->window_samples == CLOCK_OFFSET_WINDOW) {
+        offset->previous_min = offset->window_min;
+        offset->has_previous = true;
+        offset->window_samples = 0;
+    }
+}
+
+static uint32_t clock_offset_get(const struct clock_offset *offset) {
+    if (offset->has_previous &&
+        (offset->window_samples == 0 ||
+         clock_offset_before(offset->previous_min, offset->window_min))) {
+        return offset->previous_min;
+    }
+
+    return offset->window_min;
+}
+
+static uint8_t split_central_position_events_notify_func(struct bt_conn *conn,
+                                                         struct bt_gatt_subscribe_params *params,
+                                                         const void *data, uint16_t length) {
+    struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+
+    if (slot == NULL) {
+        LOG_ERR("No peripheral state found for connection");
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    if (!data) {
+        LOG_DBG("[UNSUBSCRIBED]");
+        params->value_handle = 0U;
+        return BT_GATT_ITER_STOP;
+    }
+
+    LOG_DBG("[POSITION EVENTS NOTIFICATION] data %p length %u", data, length);
+
+    struct zmk_split_position_events_header header;
+    if (length < sizeof(header)) {
+        LOG_WRN("Ignoring position events notify with insufficient data length (%d)", length);
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    uint32_t sent = sys_le32_to_cpu(header.timestamp);
+
+    int64_t now = k_uptime_get();
+    clock_offset_add_sample(&slot->clock_offset, (uint32_t)now - sent);
+    uint32_t offset = clock_offset_get(&slot->clock_offset);
+    int source = peripheral_slot_index_for_conn(conn);
+
+    for (size_t pos = sizeof(header); pos + sizeof(struct zmk_split_position_event) <= length;
+         pos += sizeof(struct zmk_split_position_event)) {
+        struct zmk_split_position_event record;
+        memcpy(&record, (const uint8_t *)data + pos, sizeof(record));
+
+        uint8_t position = record.position_state & ZMK_SPLIT_POSITION_EVENT_POSITION_MASK;
+        bool pressed = record.position_state & ZMK_SPLIT_POSITION_EVENT_PRESSED;
+
+        // when the change happened on the peripheral, moved to our clock. It can't be in the
+        // future, even if the offset estimate is still catching up.
+        uint32_t changed = sent - sys_le16_to_cpu(record.age_ms) + offset;
+        int64_t timestamp = now - MAX((int32_t)((uint32_t)now - changed), 0);
+
+        // kept up to date so the positions can be released if the peripheral disconnects
+        WRITE_BIT(slot->position_state[position / 8], position % 8, pressed);
+
+        struct zmk_position_state_changed ev = {
+            .source = source, .position = position, .state = pressed, .timestamp = timestamp};
+
+        k_msgq_put(&peripheral_event_msgq, &ev, K_NO_WAIT);
+        k_work_submit(&peripheral_event_work);
+    }
+
+    return BT_GATT_ITER_CONTINUE;
+}
+
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
 #if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_BATTERY_LEVEL_FETCHING)
 
 static uint8_t peripheral_battery_levels[ZMK_SPLIT_BLE_PERIPHERAL_COUNT] = {0};
@@ -396,6 +516,14 @@ static uint8_t split_central_chrc_discovery_func(struct bt_conn *conn,
                                                  struct bt_gatt_discover_params *params) {
     if (!attr) {
         LOG_DBG("Discover complete");
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+        struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+        if (slot != NULL && slot->subscribe_params.value_handle &&
+            !slot->events_subscribe_params.value_handle) {
+            LOG_DBG("Peripheral has no position events, using position state");
+            split_central_subscribe(conn, &slot->subscribe_params);
+        }
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
         return BT_GATT_ITER_STOP;
     }
 
@@ -420,7 +548,22 @@ static uint8_t split_central_chrc_discovery_func(struct bt_conn *conn,
         slot->subscribe_params.value_handle = bt_gatt_attr_value_handle(attr);
         slot->subscribe_params.notify = split_central_notify_func;
         slot->subscribe_params.value = BT_GATT_CCC_NOTIFY;
-        split_central_subscribe(conn, &slot->subscribe_params);
+        // with position events, this is only subscribed once discovery shows the peripheral
+        // does not have them
+        if (!IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)) {
+            split_central_subscribe(conn, &slot->subscribe_params);
+        }
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+    } else if (bt_uuid_cmp(chrc_uuid,
+                           BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_POSITION_EVENTS_UUID)) == 0) {
+        LOG_DBG("Found position events characteristic");
+        slot->events_subscribe_params.disc_params = &slot->sub_discover_params;
+        slot->events_subscribe_params.end_handle = slot->discover_params.end_handle;
+        slot->events_subscribe_params.value_handle = bt_gatt_attr_value_handle(attr);
+        slot->events_subscribe_params.notify = split_central_position_events_notify_func;
+        slot->events_subscribe_params.value = BT_GATT_CCC_NOTIFY;
+        split_central_subscribe(conn, &slot->events_subscribe_params);
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
 #if ZMK_KEYMAP_HAS_SENSORS
     } else if (bt_uuid_cmp(chrc_uuid, BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_SENSOR_STATE_UUID)) ==
                0) {
@@ -468,6 +611,11 @@ static uint8_t split_central_chrc_discovery_func(struct bt_conn *conn,
 
     bool subscribed = slot->run_behavior_handle && slot->subscribe_params.value_handle;
 
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+    // keep looking until the end of the service for peripherals without position events
+    subscribed = subscribed && slot->events_subscribe_params.value_handle;
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
 #if ZMK_KEYMAP_HAS_SENSORS
     subscribed = subscribed && slot->sensor_subscribe_params.value_handle;
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
@@ -874,4 +1022,4 @@ static int zmk_split_bt_central_init(void) {
     return IS_ENABLED(CONFIG_ZMK_BLE_CLEAR_BONDS_ON_START) ? 0 : start_scanning();
 }
 
-SYS_INIT(zmk_split_bt_central_init, APPLICATION, CONFIG_ZMK_BLE_INIT_PRIORITY);
+ZMK_SYS_INIT(zmk_split_bt_central_init, APPLICATION, CONFIG_ZMK_BLE_INIT_PRIORITY);
@@ -8,6 +8,8 @@
 #include <zephyr/types.h>
 #include <zephyr/sys/util.h>
 #include <zephyr/init.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
 
 #include <zephyr/logging/log.h>
 
@@ -28,6 +30,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #include <zmk/events/sensor_event.h>
 #include <zmk/sensors.h>
+#include <zmk/boot_profiler.h>
 
 #if ZMK_KEYMAP_HAS_SENSORS
 static struct sensor_event last_sensor_event;
@@ -110,6 +113,22 @@ static void split_svc_pos_state_ccc(const struct bt_gatt_attr *attr, uint16_t va
     LOG_DBG("value %d", value);
 }
 
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
+// Set while the central is subscribed to position events, which means it understands them
+// and no longer needs the position state bitmap notified.
+static atomic_t position_events_subscribed = ATOMIC_INIT(0);
+static atomic_t position_events_in_flight = ATOMIC_INIT(0);
+
+static void split_svc_pos_events_ccc(const struct bt_gatt_attr *attr, uint16_t value) {
+    LOG_DBG("value %d", value);
+    atomic_set(&position_events_subscribed, value == BT_GATT_CCC_NOTIFY);
+    // a notification pending on a dropped connection never completes
+    atomic_set(&position_events_in_flight, 0);
+}
+
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
 #if IS_ENABLED(CONFIG_ZMK_SPLIT_PERIPHERAL_HID_INDICATORS)
 
 static zmk_hid_indicators_t hid_indicators = 0;
@@ -160,6 +179,11 @@ BT_GATT_SERVICE_DEFINE(
                            BT_GATT_CHRC_WRITE_WITHOUT_RESP, BT_GATT_PERM_WRITE_ENCRYPT, NULL,
                            split_svc_update_indicators, NULL),
 #endif // IS_ENABLED(CONFIG_ZMK_SPLIT_PERIPHERAL_HID_INDICATORS)
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_POSITION_EVENTS_UUID),
+                           BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(split_svc_pos_events_ccc, BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT),
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
 );
 
 K_THREAD_STACK_DEFINE(service_q_stack, CONFIG_ZMK_SPLIT_BLE_PERIPHERAL_STACK_SIZE);
@@ -203,14 +227,155 @@ int send_position_state() {
     return 0;
 }
 
-int zmk_split_bt_position_pressed(uint8_t position) {
-    WRITE_BIT(position_state[position / 8], position % 8, true);
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
+// Every connection supports at least the default ATT MTU of 23, leaving 20 bytes of payload.
+#define POSITION_EVENTS_MAX_PAYLOAD 20
+#define POSITION_EVENTS_PER_NOTIFICATION                                                           \
+    ((POSITION_EVENTS_MAX_PAYLOAD - sizeof(struct zmk_split_position_events_header)) /             \
+     sizeof(struct zmk_split_position_event))
+// retry delay after a notification could not be sent
+#define POSITION_EVENTS_RETRY_MS 5
+
+struct queued_position_event {
+    uint8_t position_state;
+    int64_t timestamp;
+};
+
+K_MSGQ_DEFINE(position_event_msgq, sizeof(struct queued_position_event),
+              CONFIG_ZMK_SPLIT_BLE_PERIPHERAL_POSITION_QUEUE_SIZE, 4);
+
+// Events taken off the queue that have not been notified yet. A failed notification keeps them
+// here to be sent again, since a lost release would leave the key held on the central. Only
+// used from service_work_q.
+static struct queued_position_event unsent_events[POSITION_EVENTS_PER_NOTIFICATION];
+static size_t unsent_count;
+
+static void send_position_events_callback(struct k_work *work);
+
+K_WORK_DELAYABLE_DEFINE(service_position_events_work, send_position_events_callback);
+
+static void submit_position_events_work(void) {
+    k_work_reschedule_for_queue(&service_work_q, &service_position_events_work, K_NO_WAIT);
+}
+
+static void position_events_sent(struct bt_conn *conn, void *user_data) {
+    atomic_set(&position_events_in_flight, 0);
+    submit_position_events_work();
+}
+
+// Only one notification is in flight at a time. Changes queued while it is being sent go out
+// together in the next one, so a burst of changes costs one notification per connection event.
+static void send_position_events_callback(struct k_work *work) {
+    if (atomic_get(&position_events_in_flight)) {
+        return;
+    }
+
+    // nothing is retried once the central has unsubscribed, e.g. after it disconnected
+    if (!atomic_get(&position_events_subscribed)) {
+        unsent_count = 0;
+        return;
+    }
+
+    struct {
+        struct zmk_split_position_events_header header;
+        struct zmk_split_position_event records[POSITION_EVENTS_PER_NOTIFICATION];
+    } __packed payload;
+    int64_t now = k_uptime_get();
+
+    // unsent events are older than the queued ones, so they go first
+    while (unsent_count < ARRAY_SIZE(unsent_events) &&
+           k_msgq_get(&position_event_msgq, &unsent_events[unsent_count], K_NO_WAIT) == 0) {
+        unsent_count++;
+    }
+
+    if (unsent_count == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < unsent_count; i++) {
+        payload.records[i] = (struct zmk_split_position_event){
+            .position_state = unsent_events[i].position_state,
+            .age_ms = sys_cpu_to_le16(CLAMP(now - unsent_events[i].timestamp, 0, UINT16_MAX)),
+        };
+    }
+
+    payload.header.timestamp = sys_cpu_to_le32((uint32_t)now);
+
+    static const struct bt_gatt_attr *position_events_attr;
+    if (position_events_attr == NULL) {
+        position_events_attr =
+            bt_gatt_find_by_uuid(split_svc.attrs, split_svc.attr_count,
+                                 BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_POSITION_EVENTS_UUID));
+    }
+
+    struct bt_gatt_notify_params notify_params = {
+        .attr = position_events_attr,
+        .data = &payload,
+        .len = sizeof(payload.header) + unsent_count * sizeof(payload.records[0]),
+        .func = position_events_sent,
+    };
+
+    atomic_set(&position_events_in_flight, 1);
+    int err = bt_gatt_notify_cb(NULL, &notify_params);
+    if (err) {
+        LOG_DBG("Error notifying %d, retrying", err);
+        atomic_set(&position_events_in_flight, 0);
+        k_work_reschedule_for_queue(&service_work_q, &service_position_events_work,
+                                    K_MSEC(POSITION_EVENTS_RETRY_MS));
+        return;
+    }
+
+    unsent_count = 0;
+}
+
+static int send_position_event(uint8_t position, bool pressed, int64_t timestamp) {
+    struct queued_position_event queued = {
+        .position_state = (position & ZMK_SPLIT_POSITION_EVENT_POSITION_MASK) |
+                          (pressed ? ZMK_SPLIT_POSITION_EVENT_PRESSED : 0),
+        .timestamp = timestamp,
+    };
+
+    int err = k_msgq_put(&position_event_msgq, &queued, K_MSEC(100));
+    if (err) {
+        switch (err) {
+        case -EAGAIN: {
+            LOG_WRN("Position event message queue full, popping first message and queueing again");
+            struct queued_position_event discarded;
+            k_msgq_get(&position_event_msgq, &discarded, K_NO_WAIT);
+            return send_position_event(position, pressed, timestamp);
+        }
+        default:
+            LOG_WRN("Failed to queue position event to send (%d)", err);
+            return err;
+        }
+    }
+
+    submit_position_events_work();
+
+    return 0;
+}
+
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
+static int send_position_change(uint8_t position, bool pressed, int64_t timestamp) {
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+    if (atomic_get(&position_events_subscribed)) {
+        return send_position_event(position, pressed, timestamp);
+    }
+#endif // IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_POSITION_EVENTS)
+
     return send_position_state();
 }
 
-int zmk_split_bt_position_released(uint8_t position) {
+int zmk_split_bt_position_pressed(uint8_t position, int64_t timestamp) {
+    WRITE_BIT(position_state[position / 8], position % 8, true);
+    return send_position_change(position, true, timestamp);
+}
+
+int zmk_split_bt_position_released(uint8_t position, int64_t timestamp) {
     WRITE_BIT(position_state[position / 8], position % 8, false);
-    return send_position_state();
+    return send_position_change(position, false, timestamp);
 }
 
 #if ZMK_KEYMAP_HAS_SENSORS
@@ -274,4 +439,4 @@ static int service_init(void) {
     return 0;
 }
 
-SYS_INIT(service_init, APPLICATION, CONFIG_ZMK_BLE_INIT_PRIORITY);
+ZMK_SYS_INIT(service_init, APPLICATION, CONFIG_ZMK_BLE_INIT_PRIORITY);
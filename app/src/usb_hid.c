@@ -12,11 +12,13 @@
 
 #include <zmk/usb.h>
 #include <zmk/hid.h>
+#include <zmk/latency_trace.h>
 #include <zmk/keymap.h>
 #if IS_ENABLED(CONFIG_ZMK_HID_INDICATORS)
 #include <zmk/hid_indicators.h>
 #endif // IS_ENABLED(CONFIG_ZMK_HID_INDICATORS)
 #include <zmk/event_manager.h>
+#include <zmk/boot_profiler.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -150,7 +152,11 @@ static int zmk_usb_hid_send_report(const uint8_t *report, size_t len) {
 int zmk_usb_hid_send_keyboard_report(void) {
     size_t len;
     uint8_t *report = get_keyboard_report(&len);
-    return zmk_usb_hid_send_report(report, len);
+    int err = zmk_usb_hid_send_report(report, len);
+    if (err == 0) {
+        zmk_latency_trace_mark_current(ZMK_LATENCY_TRACE_STAGE_REPORT);
+    }
+    return err;
 }
 
 int zmk_usb_hid_send_consumer_report(void) {
@@ -195,4 +201,4 @@ static int zmk_usb_hid_init(void) {
     return 0;
 }
 
-SYS_INIT(zmk_usb_hid_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+ZMK_SYS_INIT(zmk_usb_hid_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
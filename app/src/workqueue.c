@@ -8,6 +8,7 @@
 #include <zephyr/device.h>
 
 #include <zmk/workqueue.h>
+#include <zmk/boot_profiler.h>
 
 K_THREAD_STACK_DEFINE(lowprio_q_stack, CONFIG_ZMK_LOW_PRIORITY_THREAD_STACK_SIZE);
 
@@ -24,4 +25,4 @@ static int workqueue_init(void) {
     return 0;
 }
 
-SYS_INIT(workqueue_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+ZMK_SYS_INIT(workqueue_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
@@ -17,6 +17,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/events/keycode_state_changed.h>
 
 #include <zmk/wpm.h>
+#include <zmk/boot_profiler.h>
 
 #define WPM_UPDATE_INTERVAL_SECONDS 1
 #define WPM_RESET_INTERVAL_SECONDS 5
@@ -82,4 +83,4 @@ static int wpm_init(void) {
 ZMK_LISTENER(wpm, wpm_event_listener);
 ZMK_SUBSCRIPTION(wpm, zmk_keycode_state_changed);
 
-SYS_INIT(wpm_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+ZMK_SYS_INIT(wpm_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);